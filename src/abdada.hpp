@@ -0,0 +1,56 @@
+// clang-format off
+
+#pragma once
+
+#include "utils.hpp"
+#include "move.hpp"
+#include <atomic>
+#include <vector>
+
+// Simplified ABDADA (deferred move sharing)
+// While a thread searches a move, it marks the (position, move) pair as busy
+// Other threads reaching the same position defer that move to the end of their moves loop
+// Marks live in a small lockless hash table, separate from the TT
+
+constexpr size_t ABDADA_TABLE_SIZE = 1ULL << 15; // Entries, must be a power of 2
+
+// Only share work at nodes with at least this depth
+constexpr i32 ABDADA_MIN_DEPTH = 3;
+
+class AbdadaTable
+{
+private:
+
+    std::vector<std::atomic<u64>> mEntries
+        = std::vector<std::atomic<u64>>(ABDADA_TABLE_SIZE);
+
+    constexpr std::atomic<u64>& entry(const u64 key)
+    {
+        return mEntries[key & (ABDADA_TABLE_SIZE - 1)];
+    }
+
+public:
+
+    static constexpr u64 moveKey(const u64 zobristHash, const Move move)
+    {
+        return zobristHash ^ (static_cast<u64>(move.asU16()) * 0x9E3779B97F4A7C15ULL);
+    }
+
+    constexpr bool isBusy(const u64 key)
+    {
+        return entry(key).load(std::memory_order_relaxed) == key;
+    }
+
+    constexpr void setBusy(const u64 key)
+    {
+        entry(key).store(key, std::memory_order_relaxed);
+    }
+
+    constexpr void resetBusy(const u64 key)
+    {
+        // Don't clear a newer mark of another move that collided into this entry
+        u64 expected = key;
+        entry(key).compare_exchange_strong(expected, 0, std::memory_order_relaxed);
+    }
+
+}; // class AbdadaTable
@@ -4,6 +4,14 @@
 
 #include "utils.hpp"
 
+// Slider attacks tables are indexed with PEXT on BMI2 CPUs, otherwise with magics
+// PEXT is microcoded and very slow on AMD CPUs before Zen 3, compile those with -DNO_PEXT
+#if defined(__BMI2__) && !defined(NO_PEXT)
+    constexpr bool USE_PEXT = true;
+#else
+    constexpr bool USE_PEXT = false;
+#endif
+
 namespace internal {
 
 constexpr EnumArray<Bitboard, Color, Square> PAWN_ATTACKS = [] () consteval
@@ -208,6 +216,7 @@ public:
     Bitboard attacksEmptyBoardNoEdges;
     u64 magic;
     u64 shift;
+    size_t offset; // Start of this square's attacks in the attacks table
 };
 
 constexpr EnumArray<MagicEntry, Square> BISHOP_MAGIC_ENTRIES = [] () consteval
@@ -232,6 +241,7 @@ constexpr EnumArray<MagicEntry, Square> BISHOP_MAGIC_ENTRIES = [] () consteval
     };
 
     EnumArray<MagicEntry, Square> bishopMagicEntries;
+    size_t offset = 0;
 
     for (const Square square : EnumIter<Square>())
     {
@@ -246,6 +256,10 @@ constexpr EnumArray<MagicEntry, Square> BISHOP_MAGIC_ENTRIES = [] () consteval
         magicEntry.shift = static_cast<u64>(
             64 - std::popcount(magicEntry.attacksEmptyBoardNoEdges)
         );
+
+        // Each square's attacks take 2^(relevant blockers) entries
+        magicEntry.offset = offset;
+        offset += 1ULL << std::popcount(magicEntry.attacksEmptyBoardNoEdges);
     }
 
     return bishopMagicEntries;
@@ -273,6 +287,7 @@ constexpr EnumArray<MagicEntry, Square> ROOK_MAGIC_ENTRIES = [] () consteval
     };
 
     EnumArray<MagicEntry, Square> rookMagicEntries;
+    size_t offset = 0;
 
     for (const Square square : EnumIter<Square>())
     {
@@ -304,15 +319,38 @@ constexpr EnumArray<MagicEntry, Square> ROOK_MAGIC_ENTRIES = [] () consteval
         magicEntry.shift = static_cast<u64>(
             64 - std::popcount(magicEntry.attacksEmptyBoardNoEdges)
         );
+
+        // Each square's attacks take 2^(relevant blockers) entries
+        magicEntry.offset = offset;
+        offset += 1ULL << std::popcount(magicEntry.attacksEmptyBoardNoEdges);
     }
 
     return rookMagicEntries;
 }();
 
-// [square][index]
-constexpr MultiArray<Bitboard, 64, 1ULL << 9> BISHOP_ATTACKS_TABLE = [] () consteval
+// Index of the slider's attacks in its square's attacks table
+constexpr size_t attacksIdx(const MagicEntry& magicEntry, const Bitboard occupied)
+{
+    if constexpr (USE_PEXT)
+        return pext(occupied, magicEntry.attacksEmptyBoardNoEdges);
+    else
+    {
+        const Bitboard blockers = occupied & magicEntry.attacksEmptyBoardNoEdges;
+        return (blockers * magicEntry.magic) >> magicEntry.shift;
+    }
+}
+
+constexpr size_t BISHOP_ATTACKS_TABLE_SIZE
+    = BISHOP_MAGIC_ENTRIES[Square::H8].offset
+    + (1ULL << std::popcount(BISHOP_MAGIC_ENTRIES[Square::H8].attacksEmptyBoardNoEdges));
+
+static_assert(BISHOP_ATTACKS_TABLE_SIZE == 5248);
+
+// Squares' attacks are packed back to back, each starting at its magic entry's offset
+// [offset + index]
+constexpr std::array<Bitboard, BISHOP_ATTACKS_TABLE_SIZE> BISHOP_ATTACKS_TABLE = [] () consteval
 {
-    MultiArray<Bitboard, 64, 1ULL << 9> bishopAttacksTable = { };
+    std::array<Bitboard, BISHOP_ATTACKS_TABLE_SIZE> bishopAttacksTable = { };
 
     for (const Square square : EnumIter<Square>())
     {
@@ -324,20 +362,26 @@ constexpr MultiArray<Bitboard, 64, 1ULL << 9> BISHOP_ATTACKS_TABLE = [] () const
         for (size_t n = 0; n < numBlockersArrangements; n++)
         {
             const Bitboard blockers = pdep(n, magicEntry.attacksEmptyBoardNoEdges);
-            const size_t idx = (blockers * magicEntry.magic) >> magicEntry.shift;
+            const size_t idx = attacksIdx(magicEntry, blockers);
 
-            bishopAttacksTable[static_cast<size_t>(square)][idx]
-                = bishopAttacksSlow(square, blockers);
+            bishopAttacksTable[magicEntry.offset + idx] = bishopAttacksSlow(square, blockers);
         }
     }
 
     return bishopAttacksTable;
 }();
 
-// [square][index]
-constexpr MultiArray<Bitboard, 64, 1ULL << 12> ROOK_ATTACKS_TABLE = [] () consteval
+constexpr size_t ROOK_ATTACKS_TABLE_SIZE
+    = ROOK_MAGIC_ENTRIES[Square::H8].offset
+    + (1ULL << std::popcount(ROOK_MAGIC_ENTRIES[Square::H8].attacksEmptyBoardNoEdges));
+
+static_assert(ROOK_ATTACKS_TABLE_SIZE == 102400);
+
+// Squares' attacks are packed back to back, each starting at its magic entry's offset
+// [offset + index]
+constexpr std::array<Bitboard, ROOK_ATTACKS_TABLE_SIZE> ROOK_ATTACKS_TABLE = [] () consteval
 {
-    MultiArray<Bitboard, 64, 1ULL << 12> rookAttacksTable = { };
+    std::array<Bitboard, ROOK_ATTACKS_TABLE_SIZE> rookAttacksTable = { };
 
     for (const Square square : EnumIter<Square>())
     {
@@ -349,10 +393,9 @@ constexpr MultiArray<Bitboard, 64, 1ULL << 12> ROOK_ATTACKS_TABLE = [] () conste
         for (size_t n = 0; n < numBlockersArrangements; n++)
         {
             const Bitboard blockers = pdep(n, magicEntry.attacksEmptyBoardNoEdges);
-            const size_t idx = (blockers * magicEntry.magic) >> magicEntry.shift;
+            const size_t idx = attacksIdx(magicEntry, blockers);
 
-            rookAttacksTable[static_cast<size_t>(square)][idx]
-                = rookAttacksSlow(square, blockers);
+            rookAttacksTable[magicEntry.offset + idx] = rookAttacksSlow(square, blockers);
         }
     }
 
@@ -377,10 +420,7 @@ constexpr Bitboard getBishopAttacks(const Square square, const Bitboard occupied
 
     const MagicEntry& magicEntry = BISHOP_MAGIC_ENTRIES[square];
 
-    const Bitboard blockers = occupied & magicEntry.attacksEmptyBoardNoEdges;
-    const size_t idx = (blockers * magicEntry.magic) >> magicEntry.shift;
-
-    return BISHOP_ATTACKS_TABLE[static_cast<size_t>(square)][idx];
+    return BISHOP_ATTACKS_TABLE[magicEntry.offset + attacksIdx(magicEntry, occupied)];
 }
 
 constexpr Bitboard getRookAttacks(const Square square, const Bitboard occupied)
@@ -389,10 +429,7 @@ constexpr Bitboard getRookAttacks(const Square square, const Bitboard occupied)
 
     const MagicEntry& magicEntry = ROOK_MAGIC_ENTRIES[square];
 
-    const Bitboard blockers = occupied & magicEntry.attacksEmptyBoardNoEdges;
-    const size_t idx = (blockers * magicEntry.magic) >> magicEntry.shift;
-
-    return ROOK_ATTACKS_TABLE[static_cast<size_t>(square)][idx];
+    return ROOK_ATTACKS_TABLE[magicEntry.offset + attacksIdx(magicEntry, occupied)];
 }
 
 constexpr Bitboard getQueenAttacks(const Square square, const Bitboard occupied)
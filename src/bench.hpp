@@ -5,6 +5,11 @@
 #include "utils.hpp"
 #include "position.hpp"
 #include "search.hpp"
+#include "perf_counters.hpp"
+#include <iomanip>
+#include <sstream>
+
+constexpr i32 BENCH_DEPTH = 14;
 
 constexpr std::array BENCH_FENS {
     "r3k2r/2pb1ppp/2pp1q2/p7/1nP1B3/1P2P3/P2N1PPP/R2QK2R w KQkq a6 0 14",
@@ -61,30 +66,438 @@ constexpr std::array BENCH_FENS {
     "7k/8/7P/5B2/5K2/8/8/8 b - - 0 175"
 };
 
-inline void bench(const i32 depth = 14)
+// Games (moves from startpos) whose positions are searched by speedtest
+constexpr std::array SPEEDTEST_GAMES {
+    "e2e4 e7e5 g1f3 b8c6 f1b5 a7a6 b5a4 g8f6 e1g1 f8e7 f1e1 b7b5 a4b3 d7d6 c2c3 e8g8 h2h3 "
+    "c6b8 d2d4 b8d7 b1d2 c8b7 b3c2 f8e8 d2f1 e7f8 f1g3 g7g6 a2a4 c7c5 d4d5 c5c4 c1g5 h7h6 "
+    "g5e3 d7c5 d1d2 h6h5 e3g5 f8e7 g3f5 g6f5 g5f6 e7f6 e4f5 e5e4 c2e4 c5e4 e1e4 e8e4 d2h6 "
+    "d8e7",
+    "e2e4 c7c5 g1f3 d7d6 d2d4 c5d4 f3d4 g8f6 b1c3 a7a6 c1e3 e7e5 d4b3 c8e6 f2f3 f8e7 d1d2 "
+    "e8g8 e1c1 b8d7 g2g4 b7b5 g4g5 b5b4 c3e2 f6e8 f3f4 a6a5 f4f5 a5a4 b3d4 e5d4 e2d4 b4b3 "
+    "c1b1 b3c2 d4c2 e6b3 a2b3 a4b3 c2a3 d7e5 h2h4 a8a3 b2a3 d8a5",
+    "d2d4 d7d5 c2c4 e7e6 b1c3 g8f6 c1g5 f8e7 e2e3 e8g8 g1f3 h7h6 g5h4 b7b6 f1e2 c8b7 h4f6 "
+    "e7f6 c4d5 e6d5 b2b4 c7c5 b4c5 b6c5 a1b1 b8c6 e1g1 c5d4 e3d4 f6d4 f3d4 c6d4 e2g4 d8b6 "
+    "c3d5 b7d5 d1d4 b6d4",
+    "d2d4 g8f6 c2c4 g7g6 b1c3 f8g7 e2e4 d7d6 g1f3 e8g8 f1e2 e7e5 e1g1 b8c6 d4d5 c6e7 f3e1 "
+    "f6d7 e1d3 f7f5 c1d2 d7f6 f2f3 f5f4 c4c5 g6g5 a1c1 e7g6 c3b5 a7a6 b5a3 f8f7 c5d6 c7d6 "
+    "d1b3 g5g4 a3c4 g4f3 e2f3 f6h5",
+    "c2c4 e7e5 b1c3 g8f6 g1f3 b8c6 g2g3 d7d5 c4d5 f6d5 f1g2 d5b6 e1g1 f8e7 d2d3 e8g8 a2a3 "
+    "c8e6 b2b4 a7a5 b4b5 c6d4 f3d4 e5d4 c3e4 e6d5 c1b2 c7c6 b5c6 b7c6 d1c2 a5a4 f1c1 a8a6 "
+    "e4c5 e7c5 c2c5 d5g2 g1g2",
+    "e2e4 e7e6 d2d4 d7d5 b1c3 f8b4 e4e5 c7c5 a2a3 b4c3 b2c3 g8e7 d1g4 d8c7 g4g7 h8g8 g7h7 "
+    "c5d4 g1e2 b8c6 f2f4 c8d7 h7d3 d4c3 e2c3 a7a6 a1b1 e8c8 c1e3 e7f5 e3f2 d5d4 c3e4 c6e5 "
+    "f4e5 c7c2 d3c2 c8b8"
+};
+
+struct BenchConfig
 {
-    Searcher searcher = { };
+public:
+
+    std::optional<i32> depth      = std::nullopt; // Per position
+    std::optional<u64> maxNodes   = std::nullopt; // Per position
+    std::optional<u64> moveTimeMs = std::nullopt; // Per position
+
+    // Without a depth, BENCH_DEPTH, or MAX_DEPTH if limited by nodes or time
+    // so that the nodes or time limit is what stops each search
+    constexpr i32 depthLimit() const
+    {
+        if (depth.has_value())
+            return *depth;
+
+        return maxNodes.has_value() || moveTimeMs.has_value()
+             ? static_cast<i32>(MAX_DEPTH)
+             : BENCH_DEPTH;
+    }
+
+    size_t numThreads = 1;
+    size_t hashMb = 32;
+
+    size_t numRuns = 1; // Each run searches every position with a new searcher
+
+    bool json = false;
+    bool perfCounters = false; // Hardware performance counters (Linux only)
+
+}; // struct BenchConfig
+
+// Default config is the node count signature: 1 thread, 32 MiB TT, depth 14
+// The last line is always "<nodes> nodes <nps> nps" of all runs, unless json
+inline void bench(const BenchConfig& benchConfig = { })
+{
+    // Open counters before creating the search threads so that they are counted
+    std::optional<perf::Counters> counters = std::nullopt;
+
+    if (benchConfig.perfCounters)
+        counters.emplace();
 
     SearchConfig searchConfig = { };
-    searchConfig.maxDepth = depth;
+    searchConfig.maxDepth = benchConfig.depthLimit();
+    searchConfig.maxNodes = benchConfig.maxNodes;
+    searchConfig.hardMs = benchConfig.moveTimeMs;
     searchConfig.printInfo = false;
 
+    const size_t numRuns = std::max<size_t>(benchConfig.numRuns, 1);
+
+    // Per position, summed over runs
+    std::vector<u64> positionsNodes(BENCH_FENS.size(), 0);
+    std::vector<u64> positionsMs(BENCH_FENS.size(), 0);
+    std::vector<i32> positionsDepth(BENCH_FENS.size(), 0); // Of last run
+
+    std::vector<u64> runsNodes = { }, runsMs = { };
+
+    SearchStats totalStats = { };
+
+    profiler::reset();
+
+    for (size_t run = 0; run < numRuns; run++)
+    {
+        Searcher searcher = { };
+        searcher.setThreads(benchConfig.numThreads);
+        searcher.resizeTT(benchConfig.hashMb);
+
+        if (counters.has_value())
+            counters->start();
+
+        u64 runNodes = 0, runMs = 0;
+
+        for (size_t i = 0; i < BENCH_FENS.size(); i++)
+        {
+            Position pos = Position(BENCH_FENS[i]);
+
+            searchConfig.startTime = std::chrono::steady_clock::now();
+
+            searcher.search(pos, searchConfig);
+
+            const u64 ms = millisecondsElapsed(searchConfig.startTime);
+            const u64 nodes = searcher.totalNodes();
+
+            positionsNodes[i] += nodes;
+            positionsMs[i]    += ms;
+            positionsDepth[i]  = searcher.completedDepth();
+
+            runNodes += nodes;
+            runMs    += ms;
+
+            totalStats.add(searcher.stats());
+        }
+
+        runsNodes.push_back(runNodes);
+        runsMs.push_back(runMs);
+
+        if (counters.has_value())
+            counters->stop();
+
+        // Search threads' counters are only added to ours when they exit
+    }
+
     u64 totalNodes = 0, totalMs = 0;
 
-    for (const std::string fen : BENCH_FENS)
+    for (size_t run = 0; run < numRuns; run++)
     {
-        Position pos = Position(fen);
+        totalNodes += runsNodes[run];
+        totalMs    += runsMs[run];
+    }
 
-        std::chrono::time_point<std::chrono::steady_clock> startTime
-            = std::chrono::steady_clock::now();
+    // Mean, median and standard deviation
+    const auto summary = [] (std::vector<double> values) -> std::array<double, 3>
+    {
+        if (values.empty()) return { 0.0, 0.0, 0.0 };
 
-        searcher.search(pos, searchConfig);
+        std::sort(values.begin(), values.end());
+
+        const double n = static_cast<double>(values.size());
+
+        double mean = 0.0;
+
+        for (const double value : values)
+            mean += value / n;
+
+        double variance = 0.0;
+
+        for (const double value : values)
+            variance += (value - mean) * (value - mean) / n;
+
+        const size_t mid = values.size() / 2;
+
+        const double median = values.size() % 2 == 1
+                            ? values[mid]
+                            : (values[mid - 1] + values[mid]) / 2.0;
+
+        return { mean, median, std::sqrt(variance) };
+    };
+
+    std::vector<double> runsNps = { }, positionsNps = { };
+
+    for (size_t run = 0; run < numRuns; run++)
+        runsNps.push_back(static_cast<double>(getNps(runsNodes[run], runsMs[run])));
+
+    for (size_t i = 0; i < BENCH_FENS.size(); i++)
+        positionsNps.push_back(static_cast<double>(getNps(positionsNodes[i], positionsMs[i])));
+
+    const auto [runsNpsMean, runsNpsMedian, runsNpsStdDev] = summary(runsNps);
+    const auto [posNpsMean, posNpsMedian, posNpsStdDev] = summary(positionsNps);
+
+    const std::ios_base::fmtflags oldFlags = std::cout.flags();
+    const std::streamsize oldPrecision = std::cout.precision();
+
+    std::cout << std::fixed << std::setprecision(0);
+
+    if (benchConfig.json)
+    {
+        const auto optionalToJson = [] (const std::optional<u64> value) {
+            return value.has_value() ? std::to_string(*value) : "null";
+        };
+
+        std::cout << "{\"config\":{"
+                  << "\"depth\":" << benchConfig.depthLimit()
+                  << ",\"nodes\":" << optionalToJson(benchConfig.maxNodes)
+                  << ",\"movetime\":" << optionalToJson(benchConfig.moveTimeMs)
+                  << ",\"threads\":" << benchConfig.numThreads
+                  << ",\"hash\":" << benchConfig.hashMb
+                  << ",\"runs\":" << numRuns
+                  << "},\"positions\":[";
+
+        for (size_t i = 0; i < BENCH_FENS.size(); i++)
+            std::cout << (i > 0 ? "," : "")
+                      << "{\"fen\":\"" << BENCH_FENS[i] << "\""
+                      << ",\"nodes\":" << positionsNodes[i] / numRuns
+                      << ",\"time_ms\":" << positionsMs[i] / numRuns
+                      << ",\"nps\":" << getNps(positionsNodes[i], positionsMs[i])
+                      << ",\"depth\":" << positionsDepth[i]
+                      << "}";
+
+        std::cout << "],\"runs\":[";
+
+        for (size_t run = 0; run < numRuns; run++)
+            std::cout << (run > 0 ? "," : "")
+                      << "{\"nodes\":" << runsNodes[run]
+                      << ",\"time_ms\":" << runsMs[run]
+                      << ",\"nps\":" << getNps(runsNodes[run], runsMs[run])
+                      << "}";
+
+        std::cout << "],\"nps_mean\":" << runsNpsMean
+                  << ",\"nps_median\":" << runsNpsMedian
+                  << ",\"nps_stddev\":" << runsNpsStdDev
+                  << ",\"position_nps_mean\":" << posNpsMean
+                  << ",\"position_nps_median\":" << posNpsMedian
+                  << ",\"position_nps_stddev\":" << posNpsStdDev
+                  << ",\"nodes\":" << totalNodes
+                  << ",\"nps\":" << getNps(totalNodes, totalMs);
+
+        if constexpr (STATS_ENABLED)
+        {
+            std::cout << ",\"stats\":";
+            totalStats.printJson();
+        }
+
+        if constexpr (profiler::ENABLED)
+        {
+            std::cout << ",\"profile\":";
+            profiler::printJson();
+        }
+
+        if (counters.has_value())
+        {
+            std::cout << ",\"perf\":";
+            counters->printJson(totalNodes);
+        }
 
-        totalMs += millisecondsElapsed(startTime);
-        totalNodes += searcher.totalNodes();
+        std::cout << "}" << std::endl;
+
+        std::cout.flags(oldFlags);
+        std::cout.precision(oldPrecision);
+        return;
     }
 
+    // Per position, averaged over runs
+
+    std::cout << std::setw(4) << "pos"
+              << std::setw(12) << "nodes"
+              << std::setw(10) << "time_ms"
+              << std::setw(12) << "nps"
+              << std::setw(7) << "depth"
+              << std::endl;
+
+    for (size_t i = 0; i < BENCH_FENS.size(); i++)
+        std::cout << std::setw(4) << i + 1
+                  << std::setw(12) << positionsNodes[i] / numRuns
+                  << std::setw(10) << positionsMs[i] / numRuns
+                  << std::setw(12) << getNps(positionsNodes[i], positionsMs[i])
+                  << std::setw(7) << positionsDepth[i]
+                  << std::endl;
+
+    std::cout << "position nps mean " << posNpsMean
+              << " median " << posNpsMedian
+              << " stddev " << posNpsStdDev
+              << std::endl;
+
+    if (numRuns > 1)
+        std::cout << "run nps mean " << runsNpsMean
+                  << " median " << runsNpsMedian
+                  << " stddev " << runsNpsStdDev
+                  << " (" << numRuns << " runs)"
+                  << std::endl;
+
+    std::cout.flags(oldFlags);
+    std::cout.precision(oldPrecision);
+
+    if constexpr (STATS_ENABLED)
+        totalStats.print();
+
+    if constexpr (profiler::ENABLED)
+        profiler::print();
+
+    if (counters.has_value())
+        counters->print(totalNodes);
+
     std::cout << totalNodes << " nodes "
               << getNps(totalNodes, totalMs) << " nps"
               << std::endl;
 }
+
+// SMP scaling with 1, 2, 4, ..., maxThreads threads
+// Searches the first numFens bench positions to a fixed depth with a cleared TT, and reports
+// time to depth, nodes and nps, also relative to 1 thread, and how often the best move
+// is the same as with 1 thread
+// Prints an aligned table, or CSV if csv
+// With sharedHistories, the threads share one set of history tables (SharedHistory option)
+inline void threadScaling(
+    const size_t maxThreads,
+    const i32 depth = 12,
+    const SmpMode smpMode = SmpMode::LazySMP,
+    const size_t numFens = 8,
+    const bool csv = false,
+    const bool sharedHistories = false)
+{
+    SearchConfig searchConfig = { };
+    searchConfig.maxDepth = depth;
+    searchConfig.smpMode = smpMode;
+    searchConfig.printInfo = false;
+
+    std::vector<size_t> threadCounts = { };
+
+    for (size_t numThreads = 1; numThreads < maxThreads; numThreads *= 2)
+        threadCounts.push_back(numThreads);
+
+    threadCounts.push_back(std::max<size_t>(maxThreads, 1));
+
+    const size_t fens = std::clamp<size_t>(numFens, 1, BENCH_FENS.size());
+
+    u64 baseMs = 0, baseNodes = 0, baseNps = 0;
+    std::vector<Move> baseBestMoves = { };
+
+    // a / b with 2 decimal places
+    const auto ratio = [] (const u64 a, const u64 b)
+    {
+        std::ostringstream ss;
+
+        ss << std::fixed << std::setprecision(2)
+           << static_cast<double>(a) / static_cast<double>(std::max<u64>(b, 1));
+
+        return ss.str();
+    };
+
+    const std::array<std::string, 8> columns = {
+        "threads", "time_ms", "ttd_speedup", "nodes",
+        "node_overhead", "nps", "nps_speedup", "bestmove_agree"
+    };
+
+    for (size_t i = 0; i < columns.size(); i++)
+    {
+        if (csv)
+            std::cout << (i > 0 ? "," : "") << columns[i];
+        else
+            std::cout << std::setw(i == 0 ? 7 : 15) << columns[i];
+    }
+
+    std::cout << std::endl;
+
+    Searcher searcher = { };
+    searcher.setSharedHistories(sharedHistories);
+
+    for (const size_t numThreads : threadCounts)
+    {
+        searcher.setThreads(numThreads);
+
+        u64 totalNodes = 0, totalMs = 0;
+        std::vector<Move> bestMoves = { };
+
+        for (size_t i = 0; i < fens; i++)
+        {
+            Position pos = Position(BENCH_FENS[i]);
+            searcher.ucinewgame();
+
+            searchConfig.startTime = std::chrono::steady_clock::now();
+
+            bestMoves.push_back(searcher.search(pos, searchConfig));
+
+            totalMs += millisecondsElapsed(searchConfig.startTime);
+            totalNodes += searcher.totalNodes();
+        }
+
+        const u64 nps = getNps(totalNodes, totalMs);
+
+        if (numThreads == 1)
+        {
+            baseMs    = std::max<u64>(totalMs, 1);
+            baseNodes = std::max<u64>(totalNodes, 1);
+            baseNps   = std::max<u64>(nps, 1);
+            baseBestMoves = bestMoves;
+        }
+
+        size_t sameBestMoves = 0;
+
+        for (size_t i = 0; i < fens; i++)
+            sameBestMoves += bestMoves[i] == baseBestMoves[i];
+
+        const std::array<std::string, 8> values = {
+            std::to_string(numThreads),
+            std::to_string(totalMs),
+            ratio(baseMs, totalMs),
+            std::to_string(totalNodes),
+            ratio(totalNodes, baseNodes),
+            std::to_string(nps),
+            ratio(nps, baseNps),
+            ratio(sameBestMoves * 100, fens) + "%"
+        };
+
+        for (size_t i = 0; i < values.size(); i++)
+        {
+            if (csv)
+                std::cout << (i > 0 ? "," : "") << values[i];
+            else
+                std::cout << std::setw(i == 0 ? 7 : 15) << values[i];
+        }
+
+        std::cout << std::endl;
+    }
+}
+
+// Thread pool latency of back-to-back tiny searches from startpos
+// Start latency: from search() call until the last thread starts searching
+// Stop latency: from the stop decision until search() returns
+inline void latency(Searcher& searcher, const size_t numSearches = 100)
+{
+    SearchConfig searchConfig = { };
+    searchConfig.maxDepth = 2;
+    searchConfig.printInfo = false;
+
+    Position pos = START_POS;
+
+    searcher.resetLatencyStats();
+
+    for (size_t i = 0; i < numSearches; i++)
+    {
+        searchConfig.startTime = std::chrono::steady_clock::now();
+        searcher.search(pos, searchConfig);
+    }
+
+    const LatencyStats& stats = searcher.latencyStats();
+    const u64 n = std::max<u64>(stats.numSearches, 1);
+
+    std::cout << "searches "       << stats.numSearches
+              << " start_avg_us "  << stats.totalStartNs / n / 1000
+              << " start_max_us "  << stats.maxStartNs / 1000
+              << " stop_avg_us "   << stats.totalStopNs / n / 1000
+              << " stop_max_us "   << stats.maxStopNs / 1000
+              << std::endl;
+}
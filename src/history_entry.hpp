@@ -4,30 +4,52 @@
 
 #include "utils.hpp"
 #include "search_params.hpp"
+#include <atomic>
+
+// Histories may be shared between threads, so they are accessed with relaxed atomics
+// Concurrent updates may be lost, which is fine for histories
+
+constexpr i16 loadHistory(const i16& history)
+{
+    return std::atomic_ref<i16>(const_cast<i16&>(history)).load(std::memory_order_relaxed);
+}
 
 constexpr void updateHistory(i16* historyPtr, i32 bonus)
 {
     if (historyPtr == nullptr) return;
 
-    assert(std::abs(*historyPtr) <= HISTORY_MAX);
+    std::atomic_ref<i16> history(*historyPtr);
+    const i32 oldValue = history.load(std::memory_order_relaxed);
+
+    assert(std::abs(oldValue) <= HISTORY_MAX);
 
     bonus = std::clamp<i32>(bonus, -HISTORY_MAX, HISTORY_MAX);
 
-    *historyPtr += static_cast<i16>(
-        bonus - std::abs(bonus) * static_cast<i32>(*historyPtr) / HISTORY_MAX
-    );
+    const i32 newValue = oldValue + bonus - std::abs(bonus) * oldValue / HISTORY_MAX;
+
+    assert(std::abs(newValue) <= HISTORY_MAX);
 
-    assert(std::abs(*historyPtr) <= HISTORY_MAX);
+    history.store(static_cast<i16>(newValue), std::memory_order_relaxed);
 }
 
+// Continuation history of a previous move, made by a color with a piece type to a square
+// [stm][pieceType][dst] of the move being scored
+// Contiguous, so scoring the quiet moves of a node only touches a few KiB
+using ContHistSubtable = EnumArray<i16, Color, PieceType, Square>;
+
+// [prevMoveColor][prevMovePieceType][prevMoveDst]
+using ContHistTable = EnumArray<ContHistSubtable, Color, PieceType, Square>;
+
+// Cont hist subtables of the last move (1-ply cont hist) and of the move before it (2-ply)
+// nullptr if there is no such move or it is a null move
+using ContHists = std::array<ContHistSubtable*, 2>;
+
 struct HistoryEntry
 {
 private:
 
     MultiArray<i16, 2, 2> mMainHist = { }; // [enemyAttacksSrc][enemyAttacksDst]
 
-    EnumArray<i16, Color, PieceType, Square> mContHist = { };
-
     EnumArray<i16, PieceType, PieceType> mNoisyHist = { }; // [captured][promotion] (King if none)
 
 public:
@@ -37,49 +59,46 @@ public:
     EnumArray<i16, PieceType, Square> mContCorrHist = { };
 
     // Main history + 1-ply cont hist + 2-ply cont hist
-    constexpr i32 quietHistory(Position& pos, const Move move) const
+    constexpr i32 quietHistory(Position& pos, const Move move, const ContHists& contHists) const
     {
-        const bool enemyAttacksSrc = hasSquare(pos.enemyAttacksNoStmKing(), move.from());
-        const bool enemyAttacksDst = hasSquare(pos.enemyAttacksNoStmKing(), move.to());
+        const Bitboard enemyAttacks = pos.enemyAttacksNoStmKing();
+        const bool enemyAttacksSrc = hasSquare(enemyAttacks, move.from());
+        const bool enemyAttacksDst = hasSquare(enemyAttacks, move.to());
 
-        const Move prevMove  = pos.lastMove();
-        const Move prevMove2 = pos.nthToLastMove(2);
-
-        i32 total = mMainHist[enemyAttacksSrc][enemyAttacksDst];
+        const Color stm = pos.sideToMove();
 
-        if (prevMove)
-            total += mContHist[!pos.sideToMove()][prevMove.pieceType()][prevMove.to()];
+        i32 total = loadHistory(mMainHist[enemyAttacksSrc][enemyAttacksDst]);
 
-        if (prevMove2)
-            total += mContHist[pos.sideToMove()][prevMove2.pieceType()][prevMove2.to()];
+        for (const ContHistSubtable* contHist : contHists)
+            if (contHist != nullptr)
+                total += loadHistory((*contHist)[stm][move.pieceType()][move.to()]);
 
         return total;
     }
 
     // Update main history, 1-ply cont hist and 2-ply cont hist
-    constexpr void updateMainHistContHist(Position& pos, const Move move, const i32 bonus)
+    constexpr void updateMainHistContHist(
+        Position& pos, const Move move, const ContHists& contHists, const i32 bonus)
     {
-        const bool enemyAttacksSrc = hasSquare(pos.enemyAttacksNoStmKing(), move.from());
-        const bool enemyAttacksDst = hasSquare(pos.enemyAttacksNoStmKing(), move.to());
+        const Bitboard enemyAttacks = pos.enemyAttacksNoStmKing();
+        const bool enemyAttacksSrc = hasSquare(enemyAttacks, move.from());
+        const bool enemyAttacksDst = hasSquare(enemyAttacks, move.to());
 
         const Color stm = pos.sideToMove();
 
-        const Move prevMove  = pos.lastMove();
-        const Move prevMove2 = pos.nthToLastMove(2);
-
         updateHistory(&mMainHist[enemyAttacksSrc][enemyAttacksDst], bonus);
 
-        if (prevMove)
-            updateHistory(&mContHist[!stm][prevMove.pieceType()][prevMove.to()], bonus);
-
-        if (prevMove2)
-            updateHistory(&mContHist[stm][prevMove2.pieceType()][prevMove2.to()], bonus);
+        for (ContHistSubtable* contHist : contHists)
+            if (contHist != nullptr)
+                updateHistory(&(*contHist)[stm][move.pieceType()][move.to()], bonus);
     }
 
     constexpr i32 noisyHistory(
         const std::optional<PieceType> captured, const std::optional<PieceType> promotion) const
     {
-        return mNoisyHist[captured.value_or(PieceType::King)][promotion.value_or(PieceType::King)];
+        return loadHistory(
+            mNoisyHist[captured.value_or(PieceType::King)][promotion.value_or(PieceType::King)]
+        );
     }
 
     constexpr void updateNoisyHistory(
@@ -97,3 +116,34 @@ public:
 
 // [stm][pieceType][dst]
 using HistoryTable = EnumArray<HistoryEntry, Color, PieceType, Square>;
+
+// Histories of a thread, or shared by all threads
+struct Histories
+{
+public:
+
+    HistoryTable historyTable = { };
+
+    ContHistTable contHistTable = { };
+
+    // [stm][pawnsHash % CORR_HIST_SIZE]
+    EnumArray<std::array<i16, CORR_HIST_SIZE>, Color> pawnsCorrHist = { };
+
+    // [stm][pieceColor][[pieceColorNonPawnsHash % CORR_HIST_SIZE]
+    EnumArray<std::array<i16, CORR_HIST_SIZE>, Color, Color> nonPawnsCorrHist = { };
+
+    // nullptr if no move
+    constexpr ContHistSubtable* contHist(const Color moveColor, const Move move)
+    {
+        return move ? &contHistTable[moveColor][move.pieceType()][move.to()] : nullptr;
+    }
+
+    // Cont hist subtables of a position's last move and the move before it
+    // In search, they are passed down the plies instead (PlyData::contHists)
+    constexpr ContHists contHists(const Position& pos)
+    {
+        const Color stm = pos.sideToMove();
+        return { contHist(!stm, pos.lastMove()), contHist(stm, pos.nthToLastMove(2)) };
+    }
+
+}; // struct Histories
@@ -17,6 +17,9 @@ int main(int argc, char* argv[])
         std::cout << "Not using avx2 nor avx512 (slow)" << std::endl;
     #endif
 
+    if (USE_PEXT)
+        std::cout << "Using pext" << std::endl;
+
     Position pos = START_POS;
     Searcher searcher = { };
     printTTSize(searcher.mTT);
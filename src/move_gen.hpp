@@ -11,12 +11,28 @@ enum class MoveGenType : i32 {
     AllMoves = 0, NoisyOnly = 1, QuietOnly = 2
 };
 
-template<MoveGenType moveGenType>
-constexpr ArrayVec<Move, 256> pseudolegalMoves(Position& pos)
+// Functions specialized on the side to move, so that pawn directions, ranks, castling squares
+// and attacks tables rows are compile time constants
+// Call the non-template versions below, which dispatch on the side to move once
+namespace internal {
+
+// If legalOnly, only legal moves are generated, using the check and pin masks
+// Otherwise, pseudolegal moves are generated
+template<MoveGenType moveGenType, Color stm, bool legalOnly>
+constexpr ArrayVec<Move, 256> generateMoves(Position& pos)
 {
-    ArrayVec<Move, 256> pseudolegals;
+    PROFILE_SCOPE(MoveGen);
+
+    constexpr i32 UP = stm == Color::White ? 8 : -8;
+
+    constexpr Rank OUR_SECOND_RANK  = stm == Color::White ? Rank::Rank2 : Rank::Rank7;
+    constexpr Rank OUR_SEVENTH_RANK = stm == Color::White ? Rank::Rank7 : Rank::Rank2;
+
+    ArrayVec<Move, 256> moves;
 
-    const Color stm = pos.sideToMove();
+    const Bitboard us   = pos.getBb(stm);
+    const Bitboard them = pos.getBb(!stm);
+    const Bitboard occ  = us | them;
 
     const Bitboard ourPawns   = pos.getBb(stm, PieceType::Pawn);
     const Bitboard ourKnights = pos.getBb(stm, PieceType::Knight);
@@ -24,6 +40,37 @@ constexpr ArrayVec<Move, 256> pseudolegalMoves(Position& pos)
     const Bitboard ourRooks   = pos.getBb(stm, PieceType::Rook);
     const Bitboard ourQueens  = pos.getBb(stm, PieceType::Queen);
 
+    const Square kingSquare = pos.kingSquare(stm);
+
+    // Non-king moves must capture the checker or block the check
+    // In double check, non-king moves are all illegal
+    Bitboard checkMask = ~0ULL;
+
+    Bitboard pinned = 0;
+
+    if constexpr (legalOnly)
+    {
+        const Bitboard checkers = pos.checkers();
+
+        if (std::popcount(checkers) > 1)
+            checkMask = 0;
+        else if (checkers > 0)
+            checkMask = checkers | BETWEEN_EXCLUSIVE_BB[kingSquare][lsb(checkers)];
+
+        pinned = pos.pinned();
+    }
+
+    // Target squares allowed for a non-king piece on a square
+    const auto legalTargets = [&] (const Square from) constexpr -> Bitboard
+    {
+        if constexpr (!legalOnly)
+            return ~0ULL;
+        else
+            return hasSquare(pinned, from)
+                 ? checkMask & LINE_THRU_BB[kingSquare][from]
+                 : checkMask;
+    };
+
     // En passant
     if (moveGenType != MoveGenType::QuietOnly && pos.enPassantSquare().has_value())
     {
@@ -34,7 +81,27 @@ constexpr ArrayVec<Move, 256> pseudolegalMoves(Position& pos)
 
         ITERATE_BITBOARD(ourEpPawns, ourPawnSquare,
         {
-            pseudolegals.push_back(
+            // An en passant is legal if no enemy slider attacks our king after it
+            // That covers pins, the captured pawn being the checker and blocking a check
+            if constexpr (legalOnly)
+            {
+                const Bitboard occAfter = occ
+                                        ^ squareBb(ourPawnSquare)
+                                        ^ squareBb(enPassantRelative(enPassantSquare))
+                                        ^ squareBb(enPassantSquare);
+
+                const Bitboard bishopsQueens
+                    = pos.getBb(!stm, PieceType::Bishop) | pos.getBb(!stm, PieceType::Queen);
+
+                const Bitboard rooksQueens
+                    = pos.getBb(!stm, PieceType::Rook)   | pos.getBb(!stm, PieceType::Queen);
+
+                if ((bishopsQueens & getBishopAttacks(kingSquare, occAfter))
+                ||  (rooksQueens   & getRookAttacks(kingSquare, occAfter)))
+                    continue;
+            }
+
+            moves.push_back(
                 Move(ourPawnSquare, enPassantSquare, MoveFlag::EnPassant)
             );
         });
@@ -42,10 +109,10 @@ constexpr ArrayVec<Move, 256> pseudolegalMoves(Position& pos)
 
     const auto addPromos = [&] (const Square from, const Square to) constexpr
     {
-        pseudolegals.push_back(Move(from, to, MoveFlag::QueenPromo));
-        pseudolegals.push_back(Move(from, to, MoveFlag::KnightPromo));
-        pseudolegals.push_back(Move(from, to, MoveFlag::RookPromo));
-        pseudolegals.push_back(Move(from, to, MoveFlag::BishopPromo));
+        moves.push_back(Move(from, to, MoveFlag::QueenPromo));
+        moves.push_back(Move(from, to, MoveFlag::KnightPromo));
+        moves.push_back(Move(from, to, MoveFlag::RookPromo));
+        moves.push_back(Move(from, to, MoveFlag::BishopPromo));
     };
 
     #pragma clang diagnostic push
@@ -54,119 +121,115 @@ constexpr ArrayVec<Move, 256> pseudolegalMoves(Position& pos)
     // Pawns
     ITERATE_BITBOARD(ourPawns, fromSquare,
     {
-        bool pawnHasntMoved = false;
-        bool willPromote = false;
-
         const Rank rank = squareRank(fromSquare);
         assert(!isBackrank(rank));
 
-        if (rank == Rank::Rank2)
-        {
-            pawnHasntMoved = stm == Color::White;
-            willPromote    = stm == Color::Black;
-        }
-        else if (rank == Rank::Rank7)
-        {
-            pawnHasntMoved = stm == Color::Black;
-            willPromote    = stm == Color::White;
-        }
+        const bool pawnHasntMoved = rank == OUR_SECOND_RANK;
+        const bool willPromote    = rank == OUR_SEVENTH_RANK;
+
+        const Bitboard targets = legalTargets(fromSquare);
 
         if (moveGenType == MoveGenType::QuietOnly)
             goto pawnPushes;
 
         // Generate this pawn's captures
 
-        ITERATE_BITBOARD(getPawnAttacks(fromSquare, stm) & pos.them(), toSquare,
+        ITERATE_BITBOARD(getPawnAttacks(fromSquare, stm) & them & targets, toSquare,
         {
             if (willPromote)
                 addPromos(fromSquare, toSquare);
             else
-                pseudolegals.push_back(Move(fromSquare, toSquare, MoveFlag::Pawn));
+                moves.push_back(Move(fromSquare, toSquare, MoveFlag::Pawn));
         });
 
         pawnPushes:
 
-        const Square squareOneUp = add<Square>(
-            fromSquare, stm == Color::White ? 8 : -8
-        );
+        const Square squareOneUp = add<Square>(fromSquare, UP);
 
-        if (pos.isOccupied(squareOneUp))
+        if (hasSquare(occ, squareOneUp))
             continue;
 
-        if (willPromote && moveGenType != MoveGenType::QuietOnly)
+        // If in check, a single push may not block it while a double push does
+        const bool singlePushAllowed = hasSquare(targets, squareOneUp);
+
+        if (willPromote && moveGenType != MoveGenType::QuietOnly && singlePushAllowed)
             addPromos(fromSquare, squareOneUp);
 
         if (willPromote || moveGenType == MoveGenType::NoisyOnly)
             continue;
 
         // Pawn single push
-        pseudolegals.push_back(Move(fromSquare, squareOneUp, MoveFlag::Pawn));
+        if (singlePushAllowed)
+            moves.push_back(Move(fromSquare, squareOneUp, MoveFlag::Pawn));
 
         // Pawn double push
 
         if (!pawnHasntMoved) continue;
 
-        const Square squareTwoUp = add<Square>(
-            fromSquare, stm == Color::White ? 16 : -16
-        );
+        const Square squareTwoUp = add<Square>(fromSquare, UP * 2);
 
-        if (!pos.isOccupied(squareTwoUp))
-            pseudolegals.push_back(Move(fromSquare, squareTwoUp, MoveFlag::PawnDoublePush));
+        if (!hasSquare(occ, squareTwoUp) && hasSquare(targets, squareTwoUp))
+            moves.push_back(Move(fromSquare, squareTwoUp, MoveFlag::PawnDoublePush));
     });
 
-    const Bitboard occ = pos.occupied();
-
-    const Bitboard mask = moveGenType == MoveGenType::NoisyOnly ? pos.them()
+    const Bitboard mask = moveGenType == MoveGenType::NoisyOnly ? them
                         : moveGenType == MoveGenType::QuietOnly ? ~occ
-                        : ~pos.us();
+                        : ~us;
 
     // Knights
     ITERATE_BITBOARD(ourKnights, fromSquare,
     {
-        ITERATE_BITBOARD(getKnightAttacks(fromSquare) & mask, toSquare,
+        const Bitboard attacks = getKnightAttacks(fromSquare) & mask;
+
+        ITERATE_BITBOARD(attacks & legalTargets(fromSquare), toSquare,
         {
-            pseudolegals.push_back(Move(fromSquare, toSquare, MoveFlag::Knight));
+            moves.push_back(Move(fromSquare, toSquare, MoveFlag::Knight));
         });
     });
 
     // Bishops
     ITERATE_BITBOARD(ourBishops, fromSquare,
     {
-        ITERATE_BITBOARD(getBishopAttacks(fromSquare, occ) & mask, toSquare,
+        const Bitboard attacks = getBishopAttacks(fromSquare, occ) & mask;
+
+        ITERATE_BITBOARD(attacks & legalTargets(fromSquare), toSquare,
         {
-            pseudolegals.push_back(Move(fromSquare, toSquare, MoveFlag::Bishop));
+            moves.push_back(Move(fromSquare, toSquare, MoveFlag::Bishop));
         });
     });
 
     // Rooks
     ITERATE_BITBOARD(ourRooks, fromSquare,
     {
-        ITERATE_BITBOARD(getRookAttacks(fromSquare, occ) & mask, toSquare,
+        const Bitboard attacks = getRookAttacks(fromSquare, occ) & mask;
+
+        ITERATE_BITBOARD(attacks & legalTargets(fromSquare), toSquare,
         {
-            pseudolegals.push_back(Move(fromSquare, toSquare, MoveFlag::Rook));
+            moves.push_back(Move(fromSquare, toSquare, MoveFlag::Rook));
         });
     });
 
     // Queens
     ITERATE_BITBOARD(ourQueens, fromSquare,
     {
-        ITERATE_BITBOARD(getQueenAttacks(fromSquare, occ) & mask, toSquare,
+        const Bitboard attacks = getQueenAttacks(fromSquare, occ) & mask;
+
+        ITERATE_BITBOARD(attacks & legalTargets(fromSquare), toSquare,
         {
-            pseudolegals.push_back(Move(fromSquare, toSquare, MoveFlag::Queen));
+            moves.push_back(Move(fromSquare, toSquare, MoveFlag::Queen));
         });
     });
 
     #pragma clang diagnostic pop // #pragma clang diagnostic ignored "-Wshadow"
 
-    // King moves
+    // King moves and castling moves are always legal
 
-    const Square kingSquare = pos.kingSquare();
     const Bitboard enemyAttacks = pos.enemyAttacksNoStmKing();
     const Bitboard kingMoves = getKingAttacks(kingSquare) & mask & ~enemyAttacks;
 
     ITERATE_BITBOARD(kingMoves, toSquare,
     {
-        pseudolegals.push_back(Move(kingSquare, toSquare, MoveFlag::King));
+        moves.push_back(Move(kingSquare, toSquare, MoveFlag::King));
     });
 
     // If can't castle, return moves now
@@ -181,7 +244,7 @@ constexpr ArrayVec<Move, 256> pseudolegalMoves(Position& pos)
         if (!hasSquare(occ | enemyAttacks, next<Square>(kingSquare))
         &&  !hasSquare(occ | enemyAttacks, kingTo))
         {
-            pseudolegals.push_back(Move(kingSquare, kingTo, MoveFlag::Castling));
+            moves.push_back(Move(kingSquare, kingTo, MoveFlag::Castling));
         }
     }
 
@@ -192,9 +255,9 @@ constexpr ArrayVec<Move, 256> pseudolegalMoves(Position& pos)
 
         if (!hasSquare(occ | enemyAttacks, previous<Square>(kingSquare))
         &&  !hasSquare(occ | enemyAttacks, kingTo)
-        &&  !pos.isOccupied(previous<Square>(kingTo)))
+        &&  !hasSquare(occ, previous<Square>(kingTo)))
         {
-            pseudolegals.push_back(Move(kingSquare, kingTo, MoveFlag::Castling));
+            moves.push_back(Move(kingSquare, kingTo, MoveFlag::Castling));
         }
     }
 
@@ -204,13 +267,32 @@ constexpr ArrayVec<Move, 256> pseudolegalMoves(Position& pos)
         if (moveGenType == MoveGenType::AllMoves)
             return true;
 
-        for (const Move move : pseudolegals)
+        for (const Move move : moves)
             assert(pos.isQuiet(move) == (moveGenType == MoveGenType::QuietOnly));
 
         return true;
     }());
 
-    return pseudolegals;
+    return moves;
+}
+
+} // namespace internal
+
+template<MoveGenType moveGenType>
+constexpr ArrayVec<Move, 256> pseudolegalMoves(Position& pos)
+{
+    return pos.sideToMove() == Color::White
+         ? internal::generateMoves<moveGenType, Color::White, false>(pos)
+         : internal::generateMoves<moveGenType, Color::Black, false>(pos);
+}
+
+// Same moves, in the same order, as the pseudolegal moves that pass isPseudolegalLegal()
+template<MoveGenType moveGenType>
+constexpr ArrayVec<Move, 256> legalMoves(Position& pos)
+{
+    return pos.sideToMove() == Color::White
+         ? internal::generateMoves<moveGenType, Color::White, true>(pos)
+         : internal::generateMoves<moveGenType, Color::Black, true>(pos);
 }
 
 constexpr bool isPseudolegal(Position& pos, const Move move)
@@ -301,6 +383,8 @@ constexpr bool isPseudolegal(Position& pos, const Move move)
 
 constexpr bool isPseudolegalLegal(Position& pos, const Move move)
 {
+    PROFILE_SCOPE(Legality);
+
     assert(isPseudolegal(pos, move));
 
     if (move.pieceType() == PieceType::King)
@@ -345,16 +429,23 @@ constexpr bool isPseudolegalLegal(Position& pos, const Move move)
     return true;
 }
 
+namespace internal {
+
+template<Color stm>
 constexpr bool hasLegalMove(Position& pos)
 {
-    const Color stm = pos.sideToMove();
-    const Bitboard occ = pos.occupied();
+    constexpr i32 UP = stm == Color::White ? 8 : -8;
+    constexpr Rank OUR_SECOND_RANK = stm == Color::White ? Rank::Rank2 : Rank::Rank7;
+
+    const Bitboard us   = pos.getBb(stm);
+    const Bitboard them = pos.getBb(!stm);
+    const Bitboard occ  = us | them;
 
     // Does our king have legal move?
 
-    const Square kingSquare = pos.kingSquare();
+    const Square kingSquare = pos.kingSquare(stm);
     const Bitboard enemyAttacks = pos.enemyAttacksNoStmKing();
-    const Bitboard targetSquares = getKingAttacks(kingSquare) & ~pos.us() & ~enemyAttacks;
+    const Bitboard targetSquares = getKingAttacks(kingSquare) & ~us & ~enemyAttacks;
 
     if (targetSquares > 0) return true;
 
@@ -393,7 +484,7 @@ constexpr bool hasLegalMove(Position& pos)
     if (hasSquare(pos.castlingRights(), CASTLING_ROOK_FROM[stm][true])
     && !hasSquare(occ | enemyAttacks, add<Square>(kingSquare, -1))
     && !hasSquare(occ | enemyAttacks, add<Square>(kingSquare, -2))
-    && !pos.isOccupied(add<Square>(kingSquare, -3)))
+    && !hasSquare(occ, add<Square>(kingSquare, -3)))
         return true;
 
     castlingDone:
@@ -405,14 +496,14 @@ constexpr bool hasLegalMove(Position& pos)
     const Bitboard rookAttacks = getRookAttacks(kingSquare, occ);
 
     const Bitboard xrayRook
-        = rookAttacks ^ getRookAttacks(kingSquare, occ ^ (pos.us() & rookAttacks));
+        = rookAttacks ^ getRookAttacks(kingSquare, occ ^ (us & rookAttacks));
 
     Bitboard pinnersOrthogonal = pos.getBb(PieceType::Rook) | pos.getBb(PieceType::Queen);
-    pinnersOrthogonal &= xrayRook & pos.them();
+    pinnersOrthogonal &= xrayRook & them;
 
     ITERATE_BITBOARD(pinnersOrthogonal, pinnerSquare,
     {
-        pinnedOrthogonal |= pos.us() & BETWEEN_EXCLUSIVE_BB[kingSquare][pinnerSquare];
+        pinnedOrthogonal |= us & BETWEEN_EXCLUSIVE_BB[kingSquare][pinnerSquare];
     });
 
     // Calculate pinnedDiagonal
@@ -422,14 +513,14 @@ constexpr bool hasLegalMove(Position& pos)
     const Bitboard bishopAttacks = getBishopAttacks(kingSquare, occ);
 
     const Bitboard xrayBishop
-        = bishopAttacks ^ getBishopAttacks(kingSquare, occ ^ (pos.us() & bishopAttacks));
+        = bishopAttacks ^ getBishopAttacks(kingSquare, occ ^ (us & bishopAttacks));
 
     Bitboard pinnersDiagonal = pos.getBb(PieceType::Bishop) | pos.getBb(PieceType::Queen);
-    pinnersDiagonal &= xrayBishop & pos.them();
+    pinnersDiagonal &= xrayBishop & them;
 
     ITERATE_BITBOARD(pinnersDiagonal, pinnerSquare,
     {
-        pinnedDiagonal |= pos.us() & BETWEEN_EXCLUSIVE_BB[kingSquare][pinnerSquare];
+        pinnedDiagonal |= us & BETWEEN_EXCLUSIVE_BB[kingSquare][pinnerSquare];
     });
 
     // Check if our non-king pieces have a legal move
@@ -439,7 +530,7 @@ constexpr bool hasLegalMove(Position& pos)
 
     ITERATE_BITBOARD(ourKnights, fromSquare,
     {
-        if (getKnightAttacks(fromSquare) & ~pos.us() & movableBb)
+        if (getKnightAttacks(fromSquare) & ~us & movableBb)
             return true;
     });
 
@@ -447,7 +538,7 @@ constexpr bool hasLegalMove(Position& pos)
 
     ITERATE_BITBOARD(ourBishops, fromSquare,
     {
-        Bitboard bishopMoves = getBishopAttacks(fromSquare, occ) & ~pos.us() & movableBb;
+        Bitboard bishopMoves = getBishopAttacks(fromSquare, occ) & ~us & movableBb;
 
         if (hasSquare(pinnedDiagonal, fromSquare))
             bishopMoves &= LINE_THRU_BB[kingSquare][fromSquare];
@@ -459,7 +550,7 @@ constexpr bool hasLegalMove(Position& pos)
 
     ITERATE_BITBOARD(ourRooks, fromSquare,
     {
-        Bitboard rookMoves = getRookAttacks(fromSquare, occ) & ~pos.us() & movableBb;
+        Bitboard rookMoves = getRookAttacks(fromSquare, occ) & ~us & movableBb;
 
         if (hasSquare(pinnedOrthogonal, fromSquare))
             rookMoves &= LINE_THRU_BB[kingSquare][fromSquare];
@@ -469,7 +560,7 @@ constexpr bool hasLegalMove(Position& pos)
 
     ITERATE_BITBOARD(pos.getBb(stm, PieceType::Queen), fromSquare,
     {
-        Bitboard queenMoves = getQueenAttacks(fromSquare, occ) & ~pos.us() & movableBb;
+        Bitboard queenMoves = getQueenAttacks(fromSquare, occ) & ~us & movableBb;
 
         if (hasSquare(pinnedOrthogonal | pinnedDiagonal, fromSquare))
             queenMoves &= LINE_THRU_BB[kingSquare][fromSquare];
@@ -481,7 +572,7 @@ constexpr bool hasLegalMove(Position& pos)
     {
         // Pawn's captures
 
-        Bitboard pawnAttacks = getPawnAttacks(fromSquare, stm) & pos.them() & movableBb;
+        Bitboard pawnAttacks = getPawnAttacks(fromSquare, stm) & them & movableBb;
 
         if (hasSquare(pinnedDiagonal | pinnedOrthogonal, fromSquare))
             pawnAttacks &= LINE_THRU_BB[kingSquare][fromSquare];
@@ -500,20 +591,20 @@ constexpr bool hasLegalMove(Position& pos)
 
         if (pinnedHorizontally) continue;
 
-        const Square squareOneUp = add<Square>(fromSquare, stm == Color::White ? 8 : -8);
+        const Square squareOneUp = add<Square>(fromSquare, UP);
 
-        if (pos.isOccupied(squareOneUp))
+        if (hasSquare(occ, squareOneUp))
             continue;
 
         if (hasSquare(movableBb, squareOneUp))
             return true;
 
         // Pawn double push
-        if (squareRank(fromSquare) == (stm == Color::White ? Rank::Rank2 : Rank::Rank7))
+        if (squareRank(fromSquare) == OUR_SECOND_RANK)
         {
-            const Square squareTwoUp = add<Square>(fromSquare, stm == Color::White ? 16 : -16);
+            const Square squareTwoUp = add<Square>(fromSquare, UP * 2);
 
-            if (hasSquare(movableBb, squareTwoUp) && !pos.isOccupied(squareTwoUp))
+            if (hasSquare(movableBb, squareTwoUp) && !hasSquare(occ, squareTwoUp))
                 return true;
         }
     });
@@ -549,33 +640,43 @@ constexpr bool hasLegalMove(Position& pos)
         Bitboard slidingAttackersTo = bishopsQueens & getBishopAttacks(kingSquare, occAfter);
         slidingAttackersTo         |= rooksQueens   & getRookAttacks(kingSquare, occAfter);
 
-        if ((pos.them() & slidingAttackersTo) == 0)
+        if ((them & slidingAttackersTo) == 0)
             return true;
     });
 
     return false;
 }
 
+} // namespace internal
+
+constexpr bool hasLegalMove(Position& pos)
+{
+    return pos.sideToMove() == Color::White
+         ? internal::hasLegalMove<Color::White>(pos)
+         : internal::hasLegalMove<Color::Black>(pos);
+}
+
 constexpr u64 perft(Position& pos, const i32 depth)
 {
     if (depth <= 0) return 1;
 
-    const auto moves = pseudolegalMoves<MoveGenType::AllMoves>(pos);
+    const auto moves = legalMoves<MoveGenType::AllMoves>(pos);
+
+    assert(hasLegalMove(pos) == (moves.size() > 0));
+
+    // Bulk counting: the leaf nodes are the legal moves, no need to make them
+    if (depth == 1)
+        return moves.size();
+
     u64 nodes = 0;
 
     for (const Move move : moves)
-        if (isPseudolegalLegal(pos, move))
-        {
-            if (depth == 1)
-                nodes++;
-            else {
-                pos.makeMove(move);
-                nodes += perft(pos, depth - 1);
-                pos.undoMove();
-            }
-        }
+    {
+        pos.makeMove<false>(move);
+        nodes += perft(pos, depth - 1);
+        pos.undoMove();
+    }
 
-    assert(hasLegalMove(pos) == (nodes != 0));
     return nodes;
 }
 
@@ -587,18 +688,17 @@ constexpr u64 perftSplit(Position& pos, const i32 depth)
         return 1;
     }
 
-    const auto moves = pseudolegalMoves<MoveGenType::AllMoves>(pos);
+    const auto moves = legalMoves<MoveGenType::AllMoves>(pos);
     u64 totalNodes = 0;
 
     for (const Move move : moves)
-        if (isPseudolegalLegal(pos, move))
-        {
-            pos.makeMove(move);
-            const u64 nodes = perft(pos, depth - 1);
-            std::cout << move.toUci() << ": " << nodes << std::endl;
-            totalNodes += nodes;
-            pos.undoMove();
-        }
+    {
+        pos.makeMove<false>(move);
+        const u64 nodes = perft(pos, depth - 1);
+        std::cout << move.toUci() << ": " << nodes << std::endl;
+        totalNodes += nodes;
+        pos.undoMove();
+    }
 
     std::cout << "Total: " << totalNodes << std::endl;
     return totalNodes;
@@ -8,6 +8,15 @@
 #include "move_gen.hpp"
 #include "history_entry.hpp"
 
+// With -DLEGAL_MOVEGEN (make legal-movegen), the noisy and quiet moves are generated legal,
+// so they don't need a legality check when yielded
+// The TT move and killer move still need one
+#if defined(LEGAL_MOVEGEN)
+    constexpr bool LEGAL_MOVEGEN_ENABLED = true;
+#else
+    constexpr bool LEGAL_MOVEGEN_ENABLED = false;
+#endif
+
 struct ScoredMove
 {
 public:
@@ -66,7 +75,8 @@ public:
         mExcludedMove = excludedMove;
     }
 
-    constexpr ScoredMove nextLegal(Position& pos, const HistoryTable& historyTable)
+    constexpr ScoredMove nextLegal(
+        Position& pos, const HistoryTable& historyTable, const ContHists& contHists)
     {
         switch (mStage)
         {
@@ -82,12 +92,16 @@ public:
             && isPseudolegalLegal(pos, mTtMove))
                 return ScoredMove{ .move = mTtMove, .score = 0 };
 
-            return nextLegal(pos, historyTable);
+            return nextLegal(pos, historyTable, contHists);
         }
         // Generate and score noisy moves
         case 1:
         {
-            for (const Move move : pseudolegalMoves<MoveGenType::NoisyOnly>(pos))
+            const auto noisies = LEGAL_MOVEGEN_ENABLED
+                               ? legalMoves<MoveGenType::NoisyOnly>(pos)
+                               : pseudolegalMoves<MoveGenType::NoisyOnly>(pos);
+
+            for (const Move move : noisies)
                 if (move != mTtMove && move != mExcludedMove)
                 {
                     const i32 score = scoreNoisy(move, pos, historyTable);
@@ -95,7 +109,7 @@ public:
                 }
 
             mStage++;
-            return nextLegal(pos, historyTable);
+            return nextLegal(pos, historyTable, contHists);
         }
         // Yield good noisy moves
         case 2:
@@ -111,10 +125,10 @@ public:
                 // Otherwise, go on to the quiet moves
                 mStage = mNoisiesOnly ? 6 : mStage + 1;
             }
-            else if (isPseudolegalLegal(pos, scoredMove.move))
+            else if (isLegal(pos, scoredMove.move))
                 return scoredMove;
 
-            return nextLegal(pos, historyTable);
+            return nextLegal(pos, historyTable, contHists);
         }
         // Killer move (quiet)
         case 3:
@@ -131,17 +145,21 @@ public:
                 const HistoryEntry& histEntry
                     = historyTable[pos.sideToMove()][mKiller.pieceType()][mKiller.to()];
 
-                const i32 quietHist = histEntry.quietHistory(pos, mKiller);
+                const i32 quietHist = histEntry.quietHistory(pos, mKiller, contHists);
 
                 return ScoredMove{ .move = mKiller, .score = quietHist };
             }
 
-            return nextLegal(pos, historyTable);
+            return nextLegal(pos, historyTable, contHists);
         }
         // Generate and score quiet moves
         case 4:
         {
-            for (const Move move : pseudolegalMoves<MoveGenType::QuietOnly>(pos))
+            const auto quiets = LEGAL_MOVEGEN_ENABLED
+                              ? legalMoves<MoveGenType::QuietOnly>(pos)
+                              : pseudolegalMoves<MoveGenType::QuietOnly>(pos);
+
+            for (const Move move : quiets)
             {
                 if (move == mTtMove || move == mKiller || move == mExcludedMove)
                     continue;
@@ -149,13 +167,13 @@ public:
                 const HistoryEntry& histEntry
                     = historyTable[pos.sideToMove()][move.pieceType()][move.to()];
 
-                const i32 quietHist = histEntry.quietHistory(pos, move);
+                const i32 quietHist = histEntry.quietHistory(pos, move, contHists);
 
                 mQuiets.push_back(ScoredMove{ .move = move, .score = quietHist });
             }
 
             mStage++;
-            return nextLegal(pos, historyTable);
+            return nextLegal(pos, historyTable, contHists);
         }
         // Yield quiet moves
         case 5:
@@ -164,10 +182,10 @@ public:
 
             if (!scoredMove.move)
                 mStage++;
-            else if (isPseudolegalLegal(pos, scoredMove.move))
+            else if (isLegal(pos, scoredMove.move))
                 return scoredMove;
 
-            return nextLegal(pos, historyTable);
+            return nextLegal(pos, historyTable, contHists);
         }
         // Yield bad noisy moves
         case 6:
@@ -179,7 +197,7 @@ public:
                 const ScoredMove firstBadNoisy = mFirstBadNoisy;
                 mFirstBadNoisy = ScoredMove{ .move = MOVE_NONE, .score = 0 };
 
-                if (isPseudolegalLegal(pos, firstBadNoisy.move))
+                if (isLegal(pos, firstBadNoisy.move))
                     return firstBadNoisy;
             }
 
@@ -187,10 +205,10 @@ public:
 
             if (!scoredMove.move)
                 mStage++;
-            else if (isPseudolegalLegal(pos, scoredMove.move))
+            else if (isLegal(pos, scoredMove.move))
                 return scoredMove;
 
-            return nextLegal(pos, historyTable);
+            return nextLegal(pos, historyTable, contHists);
         }
         // No more legal moves
         default:
@@ -200,6 +218,15 @@ public:
         } // switch (mStage)
     }
 
+    // Legality check of a generated noisy or quiet move
+    static constexpr bool isLegal(Position& pos, const Move move)
+    {
+        if constexpr (LEGAL_MOVEGEN_ENABLED)
+            return true;
+        else
+            return isPseudolegalLegal(pos, move);
+    }
+
     constexpr i32 scoreNoisy(
         const Move move, const Position& pos, const HistoryTable& historyTable)
     {
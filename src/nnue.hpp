@@ -61,6 +61,9 @@ public:
 INCBIN(NetFile, "src/net.bin");
 const Net* NET = reinterpret_cast<const Net*>(gNetFileData);
 
+// Functions below take the net to use, so that threads can use a copy of NET
+// in their own NUMA node's memory
+
 struct FinnyTableEntry
 {
 public:
@@ -102,7 +105,7 @@ public:
 
     constexpr BothAccumulators() { } // Does not init mAccumulators
 
-    constexpr BothAccumulators(const Position& pos)
+    constexpr BothAccumulators(const Position& pos, const Net* net = NET)
     {
         // Init mMirrorVAxis
         for (const Color color : EnumIter<Color>())
@@ -117,7 +120,7 @@ public:
 
         // Init mAccumulators
 
-        mAccumulators = NET->hiddenBiases;
+        mAccumulators = net->hiddenBiases;
 
         const auto activateFeature = [&] (
             const Color pieceColor, const PieceType pt, const Square square) constexpr
@@ -130,7 +133,7 @@ public:
                 for (size_t i = 0; i < HL_SIZE; i++)
                 {
                     mAccumulators[color][i]
-                        += NET->ftWeights[color][inputBucket][pieceColor][pt][newSquare][i];
+                        += net->ftWeights[color][inputBucket][pieceColor][pt][newSquare][i];
                 }
             }
         };
@@ -169,7 +172,7 @@ private:
     }
 
     constexpr void updateFinnyEntryAndAccumulator(
-        FinnyTable& finnyTable, const Color accColor, const Position& pos)
+        FinnyTable& finnyTable, const Color accColor, const Position& pos, const Net* net)
     {
         const size_t inputBucket = mInputBucket[accColor];
         const bool mirrorVAxis   = mMirrorVAxis[accColor];
@@ -193,7 +196,7 @@ private:
                 for (size_t i = 0; i < HL_SIZE; i++)
                 {
                     finnyEntry.accumulator[i]
-                        -= NET->ftWeights[accColor][inputBucket][pieceColor][pt][newSquare][i];
+                        -= net->ftWeights[accColor][inputBucket][pieceColor][pt][newSquare][i];
                 }
             });
 
@@ -205,7 +208,7 @@ private:
                 for (size_t i = 0; i < HL_SIZE; i++)
                 {
                     finnyEntry.accumulator[i]
-                        += NET->ftWeights[accColor][inputBucket][pieceColor][pt][newSquare][i];
+                        += net->ftWeights[accColor][inputBucket][pieceColor][pt][newSquare][i];
                 }
             });
         };
@@ -223,13 +226,16 @@ private:
 public:
 
     constexpr void updateMove(
-        const BothAccumulators& prevBothAccs, const Position& pos, FinnyTable& finnyTable)
+        const BothAccumulators& prevBothAccs,
+        const Position& pos,
+        FinnyTable& finnyTable,
+        const Net* net = NET)
     {
         assert(prevBothAccs.mUpdated);
 
         if (mUpdated)
         {
-            assert(*this == nnue::BothAccumulators(pos));
+            assert(*this == nnue::BothAccumulators(pos, net));
             return;
         }
 
@@ -265,11 +271,11 @@ public:
         // rebuild our accumulator
         if  (mMirrorVAxis[colorMoving] != prevBothAccs.mMirrorVAxis[colorMoving]
         ||   mInputBucket[colorMoving] != prevBothAccs.mInputBucket[colorMoving])
-            updateFinnyEntryAndAccumulator(finnyTable, colorMoving, pos);
+            updateFinnyEntryAndAccumulator(finnyTable, colorMoving, pos, net);
 
         // If enemy input bucket changed, rebuild enemy accumulator
         if (mInputBucket[!colorMoving] != prevBothAccs.mInputBucket[!colorMoving])
-            updateFinnyEntryAndAccumulator(finnyTable, !colorMoving, pos);
+            updateFinnyEntryAndAccumulator(finnyTable, !colorMoving, pos, net);
 
         // Update accumulators with the move played
 
@@ -295,7 +301,7 @@ public:
                 if (mMirrorVAxis[color])
                     capturedSq = flipFile(capturedSq);
 
-                const auto& ftWeights = NET->ftWeights[color][inputBucket];
+                const auto& ftWeights = net->ftWeights[color][inputBucket];
 
                 for (size_t i = 0; i < HL_SIZE; i++)
                 {
@@ -316,7 +322,7 @@ public:
                     rookTo   = flipFile(rookTo);
                 }
 
-                const auto& ftWeights = NET->ftWeights[color][inputBucket][colorMoving];
+                const auto& ftWeights = net->ftWeights[color][inputBucket][colorMoving];
 
                 for (size_t i = 0; i < HL_SIZE; i++)
                 {
@@ -329,7 +335,7 @@ public:
                 }
             }
             else {
-                const auto& ftWeights = NET->ftWeights[color][inputBucket][colorMoving];
+                const auto& ftWeights = net->ftWeights[color][inputBucket][colorMoving];
 
                 for (size_t i = 0; i < HL_SIZE; i++)
                 {
@@ -343,13 +349,15 @@ public:
 
         mUpdated = true; // Everything updated
 
-        assert(*this == nnue::BothAccumulators(pos));
+        assert(*this == nnue::BothAccumulators(pos, net));
     }
 
 }; // struct BothAccumulators
 
-constexpr i32 evaluate(const BothAccumulators& bothAccs, const Color stm)
+constexpr i32 evaluate(const BothAccumulators& bothAccs, const Color stm, const Net* net = NET)
 {
+    PROFILE_SCOPE(Evaluate);
+
     assert(bothAccs.mUpdated);
 
     i32 sum = 0;
@@ -374,7 +382,7 @@ constexpr i32 evaluate(const BothAccumulators& bothAccs, const Color stm)
 
                 // Load the respective N output weights
 
-                const i16& outputWeightsStart = NET->outputWeights[color != stm][i];
+                const i16& outputWeightsStart = net->outputWeights[color != stm][i];
 
                 const Vec outputWeights = loadVec(
                     reinterpret_cast<const Vec*>(&outputWeightsStart)
@@ -399,12 +407,12 @@ constexpr i32 evaluate(const BothAccumulators& bothAccs, const Color stm)
             for (size_t i = 0; i < HL_SIZE; i++)
             {
                 const i16 clipped = std::clamp<i16>(bothAccs.mAccumulators[color][i], 0, QA);
-                const i16 x = clipped * NET->outputWeights[color != stm][i];
+                const i16 x = clipped * net->outputWeights[color != stm][i];
                 sum += static_cast<i32>(x) * static_cast<i32>(clipped);
             }
     #endif
 
-    return (sum / QA + NET->outputBias) * SCALE / (QA * QB);
+    return (sum / QA + net->outputBias) * SCALE / (QA * QB);
 }
 
 } // namespace nnue
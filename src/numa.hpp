@@ -0,0 +1,177 @@
+// clang-format off
+
+#pragma once
+
+#include "utils.hpp"
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+
+#if defined(__linux__)
+    #include <pthread.h>
+    #include <sched.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif
+
+// Thread pinning and NUMA-aware memory placement
+// Only implemented for Linux, elsewhere every function is a no-op
+
+namespace numa {
+
+// A NUMA node and the CPUs of it this process may run on
+struct Node {
+    size_t id = 0;
+    std::vector<size_t> cpus = { };
+};
+
+// NUMA nodes with at least one CPU this process may run on, by ascending node ID
+// Node IDs may have gaps (e.g. offline nodes), so they're read from sysfs, not counted
+// A single node 0 with all allowed CPUs if the topology can't be read
+// Empty if the process' CPU affinity can't be read
+inline std::vector<Node> allowedNodes()
+{
+    std::vector<Node> nodes = { };
+
+    #if defined(__linux__)
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+
+        if (sched_getaffinity(0, sizeof(cpu_set_t), &allowed) != 0)
+            return { };
+
+        const auto isAllowed = [&] (const size_t cpu) {
+            return cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed);
+        };
+
+        // Parse a cpulist like "0-3,8-11" into allowed CPUs
+        const auto parseCpuList = [&] (const std::string& cpuList)
+        {
+            std::vector<size_t> cpus = { };
+
+            for (const std::string& range : splitString(cpuList, ','))
+            {
+                const size_t dash = range.find('-');
+
+                const size_t first = std::stoull(range.substr(0, dash));
+
+                const size_t last = dash == std::string::npos
+                                  ? first
+                                  : std::stoull(range.substr(dash + 1));
+
+                for (size_t cpu = first; cpu <= last; cpu++)
+                    if (isAllowed(cpu))
+                        cpus.push_back(cpu);
+            }
+
+            return cpus;
+        };
+
+        try {
+            const std::filesystem::path nodesDir = "/sys/devices/system/node";
+
+            for (const auto& entry : std::filesystem::directory_iterator(nodesDir))
+            {
+                const std::string name = entry.path().filename().string();
+
+                const bool isNodeDir = name.size() > 4
+                                    && name.starts_with("node")
+                                    && std::all_of(name.begin() + 4, name.end(), [] (const char c) {
+                                           return std::isdigit(static_cast<unsigned char>(c));
+                                       });
+
+                if (!isNodeDir) continue;
+
+                std::ifstream file(entry.path() / "cpulist");
+
+                if (!file.is_open()) continue;
+
+                std::string cpuList = "";
+                std::getline(file, cpuList);
+                trim(cpuList);
+
+                Node node = { };
+                node.id = std::stoull(name.substr(4));
+                node.cpus = parseCpuList(cpuList);
+
+                if (!node.cpus.empty())
+                    nodes.push_back(node);
+            }
+
+            std::sort(nodes.begin(), nodes.end(), [] (const Node& a, const Node& b) {
+                return a.id < b.id;
+            });
+        }
+        catch (...) {
+            nodes.clear();
+        }
+
+        // No NUMA info, assume a single node with all allowed CPUs
+        if (nodes.empty())
+        {
+            Node node = { };
+
+            for (size_t cpu = 0; cpu < CPU_SETSIZE; cpu++)
+                if (isAllowed(cpu))
+                    node.cpus.push_back(cpu);
+
+            if (!node.cpus.empty())
+                nodes.push_back(node);
+        }
+    #endif
+
+    return nodes;
+}
+
+// Pin the calling thread to a CPU
+inline bool pinThisThread([[maybe_unused]] const size_t cpu)
+{
+    #if defined(__linux__)
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        CPU_SET(cpu, &cpuSet);
+
+        return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuSet) == 0;
+    #else
+        return false;
+    #endif
+}
+
+// Spread the pages of a memory range evenly across the given NUMA nodes
+// The range's existing pages are migrated
+inline bool interleave(
+    [[maybe_unused]] void* ptr,
+    [[maybe_unused]] const size_t bytes,
+    [[maybe_unused]] const std::vector<Node>& nodes)
+{
+    #if defined(__linux__) && defined(SYS_mbind)
+        constexpr i32 MPOL_INTERLEAVE_ = 3;
+        constexpr u32 MPOL_MF_MOVE_ = 1U << 1;
+
+        if (nodes.size() <= 1 || bytes == 0) return false;
+
+        // mbind() needs a page aligned range
+        const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        const size_t start = (reinterpret_cast<size_t>(ptr) + pageSize - 1) / pageSize * pageSize;
+        const size_t end   = (reinterpret_cast<size_t>(ptr) + bytes) / pageSize * pageSize;
+
+        if (end <= start) return false;
+
+        // Nodes are sorted by ID, so the last one has the highest ID
+        std::vector<u64> nodeMask(nodes.back().id / 64 + 1, 0);
+
+        for (const Node& node : nodes)
+            nodeMask[node.id / 64] |= 1ULL << (node.id % 64);
+
+        // The kernel ignores the last bit of maxnode, hence the + 1
+        const size_t maxNode = nodeMask.size() * 64 + 1;
+
+        return syscall(
+            SYS_mbind, start, end - start, MPOL_INTERLEAVE_, nodeMask.data(), maxNode, MPOL_MF_MOVE_
+        ) == 0;
+    #else
+        return false;
+    #endif
+}
+
+} // namespace numa
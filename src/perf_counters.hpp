@@ -0,0 +1,242 @@
+// clang-format off
+
+#pragma once
+
+#include "utils.hpp"
+#include <optional>
+#include <iomanip>
+#include <cstring>
+#include <algorithm>
+
+#if defined(__linux__)
+    #include <linux/perf_event.h>
+    #include <sys/ioctl.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif
+
+// Hardware performance counters (Linux perf_event_open)
+// Counters of threads created after the counters are opened are included, but only once
+// those threads exit, so read the counters after joining them
+// A counter that can't be opened (no PMU, VM, perf_event_paranoid, not Linux) is unavailable
+
+namespace perf {
+
+enum class Counter : i32 {
+    Cycles, Instructions, L1dMisses, LlcMisses, DtlbMisses, BranchMisses, Count
+};
+
+inline std::string counterName(const Counter counter)
+{
+    switch (counter) {
+        case Counter::Cycles:       return "cycles";
+        case Counter::Instructions: return "instructions";
+        case Counter::L1dMisses:    return "L1d-misses";
+        case Counter::LlcMisses:    return "LLC-misses";
+        case Counter::DtlbMisses:   return "dTLB-misses";
+        case Counter::BranchMisses: return "branch-misses";
+        default:                    return "";
+    }
+}
+
+class Counters
+{
+private:
+
+    EnumArray<i32, Counter> mFds; // -1 if unavailable
+
+    #if defined(__linux__)
+        static constexpr u64 cacheMissConfig(const u64 cache) {
+            return cache
+                 | (static_cast<u64>(PERF_COUNT_HW_CACHE_OP_READ) << 8)
+                 | (static_cast<u64>(PERF_COUNT_HW_CACHE_RESULT_MISS) << 16);
+        }
+
+        static inline i32 openCounter(const u32 type, const u64 config)
+        {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(perf_event_attr));
+
+            attr.size = sizeof(perf_event_attr);
+            attr.type = type;
+            attr.config = config;
+            attr.disabled = 1;
+            attr.inherit = 1; // Also count threads created later
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+            return static_cast<i32>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        }
+    #endif
+
+public:
+
+    inline Counters()
+    {
+        mFds.fill(-1);
+
+        #if defined(__linux__)
+            mFds[Counter::Cycles]
+                = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+
+            mFds[Counter::Instructions]
+                = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+
+            mFds[Counter::BranchMisses]
+                = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+
+            mFds[Counter::L1dMisses]
+                = openCounter(PERF_TYPE_HW_CACHE, cacheMissConfig(PERF_COUNT_HW_CACHE_L1D));
+
+            mFds[Counter::LlcMisses]
+                = openCounter(PERF_TYPE_HW_CACHE, cacheMissConfig(PERF_COUNT_HW_CACHE_LL));
+
+            mFds[Counter::DtlbMisses]
+                = openCounter(PERF_TYPE_HW_CACHE, cacheMissConfig(PERF_COUNT_HW_CACHE_DTLB));
+        #endif
+    }
+
+    inline ~Counters()
+    {
+        #if defined(__linux__)
+            for (const i32 fd : mFds)
+                if (fd >= 0) close(fd);
+        #endif
+    }
+
+    Counters(const Counters&) = delete;
+    Counters& operator=(const Counters&) = delete;
+
+    constexpr bool anyAvailable() const
+    {
+        return std::any_of(mFds.begin(), mFds.end(), [] (const i32 fd) { return fd >= 0; });
+    }
+
+    // Counts are kept between stop() and the next start()
+    inline void start()
+    {
+        #if defined(__linux__)
+            for (const i32 fd : mFds)
+                if (fd >= 0) ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        #endif
+    }
+
+    inline void stop()
+    {
+        #if defined(__linux__)
+            for (const i32 fd : mFds)
+                if (fd >= 0) ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        #endif
+    }
+
+    // Scaled up if the counter was multiplexed with other counters
+    inline std::optional<u64> read([[maybe_unused]] const Counter counter) const
+    {
+        #if defined(__linux__)
+            if (mFds[counter] < 0) return std::nullopt;
+
+            std::array<u64, 3> values = { }; // value, time enabled, time running
+
+            const ssize_t bytesRead = ::read(mFds[counter], values.data(), sizeof(values));
+
+            if (bytesRead != static_cast<ssize_t>(sizeof(values))
+            || values[2] == 0)
+                return std::nullopt;
+
+            return static_cast<u64>(
+                static_cast<double>(values[0])
+                * static_cast<double>(values[1])
+                / static_cast<double>(values[2])
+            );
+        #else
+            return std::nullopt;
+        #endif
+    }
+
+    // Each counter's total and per node
+    inline void print(const u64 nodes) const
+    {
+        const std::ios_base::fmtflags oldFlags = std::cout.flags();
+        const std::streamsize oldPrecision = std::cout.precision();
+
+        std::cout << std::fixed << std::setprecision(2);
+
+        for (const Counter counter : EnumIter<Counter>())
+        {
+            std::cout << std::left << std::setw(16) << counterName(counter) << std::right;
+
+            const std::optional<u64> value = read(counter);
+
+            if (!value.has_value())
+            {
+                std::cout << std::setw(16) << "n/a" << std::endl;
+                continue;
+            }
+
+            std::cout << std::setw(16) << *value
+                      << std::setw(12)
+                      << static_cast<double>(*value) / static_cast<double>(std::max<u64>(nodes, 1))
+                      << " per node" << std::endl;
+        }
+
+        const std::optional<u64> cycles = read(Counter::Cycles);
+        const std::optional<u64> instructions = read(Counter::Instructions);
+
+        if (cycles.has_value() && instructions.has_value())
+            std::cout << std::left << std::setw(16) << "IPC" << std::right << std::setw(16)
+                      << static_cast<double>(*instructions)
+                         / static_cast<double>(std::max<u64>(*cycles, 1))
+                      << std::endl;
+
+        std::cout.flags(oldFlags);
+        std::cout.precision(oldPrecision);
+    }
+
+    // Same as print(), as a JSON object without a newline (null for unavailable counters)
+    inline void printJson(const u64 nodes) const
+    {
+        const std::ios_base::fmtflags oldFlags = std::cout.flags();
+        const std::streamsize oldPrecision = std::cout.precision();
+
+        std::cout << std::fixed << std::setprecision(2) << "{";
+
+        for (const Counter counter : EnumIter<Counter>())
+        {
+            std::cout << (counter != Counter::Cycles ? "," : "")
+                      << "\"" << counterName(counter) << "\":";
+
+            const std::optional<u64> value = read(counter);
+
+            if (!value.has_value())
+            {
+                std::cout << "null";
+                continue;
+            }
+
+            std::cout << "{\"total\":" << *value
+                      << ",\"per_node\":"
+                      << static_cast<double>(*value) / static_cast<double>(std::max<u64>(nodes, 1))
+                      << "}";
+        }
+
+        const std::optional<u64> cycles = read(Counter::Cycles);
+        const std::optional<u64> instructions = read(Counter::Instructions);
+
+        std::cout << ",\"IPC\":";
+
+        if (cycles.has_value() && instructions.has_value())
+            std::cout << static_cast<double>(*instructions)
+                         / static_cast<double>(std::max<u64>(*cycles, 1));
+        else
+            std::cout << "null";
+
+        std::cout << "}";
+
+        std::cout.flags(oldFlags);
+        std::cout.precision(oldPrecision);
+    }
+
+}; // class Counters
+
+} // namespace perf
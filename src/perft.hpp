@@ -0,0 +1,292 @@
+// clang-format off
+
+#pragma once
+
+#include "utils.hpp"
+#include "position.hpp"
+#include "move_gen.hpp"
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <fstream>
+#include <iomanip>
+
+// Multithreaded perft with a shared hash table, and perft EPD suites
+// For move generator validation at high depths (perft() in move_gen.hpp is the reference)
+
+// Lockless entry: the key is stored XOR'd with the node count,
+// so an entry torn by concurrent writes fails the key check instead of giving a wrong count
+struct PerftEntry
+{
+public:
+
+    std::atomic<u64> keyXorNodes = 0;
+    std::atomic<u64> nodes = 0;
+
+}; // struct PerftEntry
+
+class PerftTable
+{
+private:
+
+    std::unique_ptr<PerftEntry[]> mEntries;
+    size_t mNumEntries = 0;
+
+    // A position's node count depends on the depth, so the depth is part of the key
+    static constexpr u64 key(const u64 zobristHash, const i32 depth)
+    {
+        return zobristHash ^ (static_cast<u64>(depth) * 0x9E3779B97F4A7C15ULL);
+    }
+
+    inline PerftEntry& entryRef(const u64 key) const
+    {
+        const size_t idx = static_cast<size_t>(
+            (static_cast<u128>(key) * static_cast<u128>(mNumEntries)) >> 64
+        );
+
+        return mEntries[idx];
+    }
+
+public:
+
+    inline PerftTable(const size_t mebibytes)
+    {
+        mNumEntries = std::max<size_t>(mebibytes * 1024 * 1024 / sizeof(PerftEntry), 1);
+        mEntries = std::make_unique<PerftEntry[]>(mNumEntries);
+    }
+
+    inline std::optional<u64> probe(const u64 zobristHash, const i32 depth) const
+    {
+        const u64 k = key(zobristHash, depth);
+        const PerftEntry& entry = entryRef(k);
+
+        const u64 nodes = entry.nodes.load(std::memory_order_relaxed);
+        const u64 keyXorNodes = entry.keyXorNodes.load(std::memory_order_relaxed);
+
+        // Empty entries are all zeros, and a count of 0 is cheap to recompute anyway
+        if (nodes == 0 || (keyXorNodes ^ nodes) != k)
+            return std::nullopt;
+
+        return nodes;
+    }
+
+    // Always replace
+    inline void store(const u64 zobristHash, const i32 depth, const u64 nodes)
+    {
+        const u64 k = key(zobristHash, depth);
+        PerftEntry& entry = entryRef(k);
+
+        entry.keyXorNodes.store(k ^ nodes, std::memory_order_relaxed);
+        entry.nodes.store(nodes, std::memory_order_relaxed);
+    }
+
+}; // class PerftTable
+
+inline u64 hashedPerft(Position& pos, const i32 depth, PerftTable& table)
+{
+    if (depth <= 0) return 1;
+
+    const auto moves = legalMoves<MoveGenType::AllMoves>(pos);
+
+    if (depth == 1)
+        return moves.size();
+
+    if (const std::optional<u64> hashedNodes = table.probe(pos.zobristHash(), depth))
+        return *hashedNodes;
+
+    u64 nodes = 0;
+
+    for (const Move move : moves)
+    {
+        pos.makeMove<false>(move);
+        nodes += hashedPerft(pos, depth - 1, table);
+        pos.undoMove();
+    }
+
+    table.store(pos.zobristHash(), depth, nodes);
+    return nodes;
+}
+
+// Node count of each root move, in legalMoves() order
+// The subtrees are split across the threads, after each root move and reply if depth >= 3,
+// so that there are enough work items to keep all threads busy until the end
+inline std::vector<std::pair<Move, u64>> parallelPerftSplit(
+    const Position& rootPos, const i32 depth, const size_t numThreads, PerftTable& table)
+{
+    assert(depth >= 1);
+
+    Position pos = rootPos;
+
+    std::vector<std::pair<Move, u64>> rootMovesNodes = { };
+
+    for (const Move move : legalMoves<MoveGenType::AllMoves>(pos))
+        rootMovesNodes.push_back({ move, depth == 1 ? 1 : 0 });
+
+    if (depth == 1) return rootMovesNodes;
+
+    struct WorkItem
+    {
+    public:
+        size_t rootMoveIdx;
+        Move reply; // MOVE_NONE if the work item is a root move's whole subtree
+        u64 nodes;
+    };
+
+    std::vector<WorkItem> workItems = { };
+
+    for (size_t i = 0; i < rootMovesNodes.size(); i++)
+    {
+        if (depth < 3)
+        {
+            workItems.push_back(WorkItem{ .rootMoveIdx = i, .reply = MOVE_NONE, .nodes = 0 });
+            continue;
+        }
+
+        pos.makeMove<false>(rootMovesNodes[i].first);
+
+        for (const Move reply : legalMoves<MoveGenType::AllMoves>(pos))
+            workItems.push_back(WorkItem{ .rootMoveIdx = i, .reply = reply, .nodes = 0 });
+
+        pos.undoMove();
+    }
+
+    std::atomic<size_t> nextWorkItemIdx = 0;
+
+    const auto work = [&] ()
+    {
+        Position threadPos = rootPos;
+
+        while (true)
+        {
+            const size_t idx = nextWorkItemIdx.fetch_add(1, std::memory_order_relaxed);
+
+            if (idx >= workItems.size()) return;
+
+            WorkItem& workItem = workItems[idx];
+
+            threadPos.makeMove<false>(rootMovesNodes[workItem.rootMoveIdx].first);
+
+            if (workItem.reply)
+            {
+                threadPos.makeMove<false>(workItem.reply);
+                workItem.nodes = hashedPerft(threadPos, depth - 2, table);
+                threadPos.undoMove();
+            }
+            else
+                workItem.nodes = hashedPerft(threadPos, depth - 1, table);
+
+            threadPos.undoMove();
+        }
+    };
+
+    std::vector<std::thread> threads = { };
+
+    for (size_t i = 1; i < std::max<size_t>(numThreads, 1); i++)
+        threads.push_back(std::thread(work));
+
+    work(); // This thread also works
+
+    for (std::thread& thread : threads)
+        thread.join();
+
+    for (const WorkItem& workItem : workItems)
+        rootMovesNodes[workItem.rootMoveIdx].second += workItem.nodes;
+
+    return rootMovesNodes;
+}
+
+inline u64 parallelPerft(
+    const Position& rootPos, const i32 depth, const size_t numThreads, PerftTable& table)
+{
+    if (depth <= 0) return 1;
+
+    u64 nodes = 0;
+
+    for (const auto& [move, moveNodes] : parallelPerftSplit(rootPos, depth, numThreads, table))
+        nodes += moveNodes;
+
+    return nodes;
+}
+
+// Runs the positions of an EPD file, whose lines are "<fen> ;D1 <nodes> ;D2 <nodes> ..."
+// Depths above maxDepth are skipped
+// Prints the result and time of each position and depth, and returns whether all counts match
+inline bool perftSuite(
+    const std::string& filePath,
+    const i32 maxDepth,
+    const size_t numThreads,
+    const size_t hashMebibytes)
+{
+    std::ifstream file(filePath);
+
+    if (!file.is_open())
+    {
+        std::cout << "info string Can't open " << filePath << std::endl;
+        return false;
+    }
+
+    PerftTable table(hashMebibytes);
+
+    size_t numPassed = 0, numFailed = 0;
+    u64 totalNodes = 0;
+
+    const std::chrono::steady_clock::time_point suiteStart = std::chrono::steady_clock::now();
+
+    std::string line;
+    size_t posIdx = 0;
+
+    while (std::getline(file, line))
+    {
+        trim(line);
+
+        if (line == "" || line[0] == '#')
+            continue;
+
+        const std::vector<std::string> fields = splitString(line, ';');
+
+        const Position pos = Position(fields[0]);
+        posIdx++;
+
+        for (size_t i = 1; i < fields.size(); i++)
+        {
+            // "D<depth> <nodes>"
+            const std::vector<std::string> depthAndNodes = splitString(fields[i], ' ');
+
+            if (depthAndNodes.size() != 2 || depthAndNodes[0][0] != 'D')
+                continue;
+
+            const i32 depth = stoi(depthAndNodes[0].substr(1));
+            const u64 expectedNodes = std::stoull(depthAndNodes[1]);
+
+            if (depth > maxDepth) continue;
+
+            const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            const u64 nodes = parallelPerft(pos, depth, numThreads, table);
+            const u64 ms = millisecondsElapsed(start);
+
+            const bool passed = nodes == expectedNodes;
+            passed ? numPassed++ : numFailed++;
+            totalNodes += nodes;
+
+            std::cout << std::setw(4) << posIdx
+                      << " D" << std::left << std::setw(3) << depth << std::right
+                      << std::setw(14) << nodes
+                      << std::setw(10) << ms << " ms "
+                      << (passed ? colored("OK", ColorCode::Green)
+                                 : colored("FAIL", ColorCode::Red)
+                                   + " (expected " + std::to_string(expectedNodes) + ")")
+                      << " " << fields[0]
+                      << std::endl;
+        }
+    }
+
+    const u64 ms = millisecondsElapsed(suiteStart);
+
+    std::cout << numPassed << " passed, " << numFailed << " failed, "
+              << totalNodes << " nodes, "
+              << ms << " ms, "
+              << getNps(totalNodes, ms) << " nps"
+              << std::endl;
+
+    return numFailed == 0;
+}
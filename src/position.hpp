@@ -7,6 +7,9 @@
 #include "attacks.hpp"
 #include "cuckoo.hpp"
 #include "search_params.hpp"
+#include "profiler.hpp"
+#include <memory>
+#include <algorithm>
 
 enum class GameState : i32 {
     Draw, Loss, Ongoing
@@ -34,52 +37,127 @@ constexpr EnumArray<std::pair<Square, Square>, Square> CASTLING_ROOK_FROM_TO = [
     return castlingRookFromTo;
 }();
 
+// Copied on every move, so kept small: no std::optional (sentinels instead),
+// small fields packed at the end and the full move counter derived from the game ply
 struct PosState
 {
 public:
-    Color colorToMove = Color::White;
     EnumArray<Bitboard, Color>     colorBbs  = { };
     EnumArray<Bitboard, PieceType> piecesBbs = { };
+
+    // Piece type on each square, PieceType::Count if empty
+    EnumArray<PieceType, Square> pieceTypes = [] () consteval
+    {
+        EnumArray<PieceType, Square> emptyBoard;
+        emptyBoard.fill(PieceType::Count);
+        return emptyBoard;
+    }();
+
+    // Squares attacked by each color's bishops, rooks and queens, with the current occupancy
+    // Updated incrementally in makeMove(), only valid if sliderAttacksValid
+    // Pawns, knights and king attacks are cheap to compute, so they aren't stored
+    EnumArray<std::array<Bitboard, 3>, Color> sliderAttacks = { }; // [color][pt - Bishop]
+
     Bitboard castlingRights = 0;
-    std::optional<Square> enPassantSquare = std::nullopt;
-    u8 pliesSincePawnOrCapture = 0;
-    u16 currentMoveCounter = 1;
-    u16 lastMove = MOVE_NONE.asU16();
-    std::optional<PieceType> captured = std::nullopt;
     Bitboard checkers = 0;
-    std::optional<Bitboard> pinned = std::nullopt;
-    std::optional<Bitboard> enemyAttacksNoStmKing = std::nullopt;
+    Bitboard pinned = 0; // Only valid if pinnedCached
     u64 zobristHash = 0;
     u64 pawnsHash = 0;
     EnumArray<u64, Color> nonPawnsHashes = { }; // [pieceColor]
+    u16 lastMove = MOVE_NONE.asU16();
+    Color colorToMove = Color::White;
+    Square enPassantSquare = Square::Count; // Square::Count if none
+    PieceType captured = PieceType::Count;  // PieceType::Count if none
+    u8 pliesSincePawnOrCapture = 0;
+    bool pinnedCached = false;
+    bool sliderAttacksValid = true; // False after a makeMove<false>()
 }; // struct PosState
 
+static_assert(sizeof(PosState) == 240);
+
+// Max states in a position's own stack
+// More than a search can add to the root's state, so search never reallocates it
+// If a game fills it, the older half of the states is moved to the shared history
+constexpr size_t MAX_OWN_STATES = 256;
+
+static_assert(MAX_OWN_STATES / 2 > MAX_DEPTH + 2);
+
 class Position
 {
 private:
+
+    // States before the ones in mStates, oldest first
+    // Immutable and shared (not copied) between copies of the position, e.g. the search threads
+    std::shared_ptr<const std::vector<PosState>> mHistoryOwner = nullptr;
+    const PosState* mHistory = nullptr;
+    size_t mHistorySize = 0;
+
+    // Fixed capacity (MAX_OWN_STATES) state stack, the last one is the current state
     std::vector<PosState> mStates = { };
+    size_t mNumStates = 0;
+
+    u16 mFirstMoveCounter = 1; // Full move counter of the first state of the game
 
     constexpr const PosState& state() const
     {
-        assert(!mStates.empty());
-        return mStates.back();
+        assert(mNumStates > 0);
+        return mStates[mNumStates - 1];
     }
 
     constexpr PosState& state()
     {
-        assert(!mStates.empty());
-        return mStates.back();
+        assert(mNumStates > 0);
+        return mStates[mNumStates - 1];
+    }
+
+    // Number of states in the game, including history
+    constexpr size_t numStates() const {
+        return mHistorySize + mNumStates;
+    }
+
+    // i-th state of the game, oldest first
+    constexpr const PosState& stateAt(const size_t i) const
+    {
+        assert(i < numStates());
+        return i < mHistorySize ? mHistory[i] : mStates[i - mHistorySize];
+    }
+
+    inline void copyFrom(const Position& other)
+    {
+        mHistoryOwner = other.mHistoryOwner;
+        mHistory      = other.mHistory;
+        mHistorySize  = other.mHistorySize;
+
+        if (mStates.size() != MAX_OWN_STATES)
+            mStates = std::vector<PosState>(MAX_OWN_STATES);
+
+        std::copy_n(other.mStates.begin(), other.mNumStates, mStates.begin());
+        mNumStates = other.mNumStates;
+
+        mFirstMoveCounter = other.mFirstMoveCounter;
     }
 
 public:
 
-    constexpr Position() = default;
+    inline Position() = default;
+
+    // Only copies the used states, the history is shared
+    inline Position(const Position& other) {
+        copyFrom(other);
+    }
+
+    inline Position& operator=(const Position& other)
+    {
+        if (this != &other)
+            copyFrom(other);
+
+        return *this;
+    }
 
     inline Position(const std::string& fen)
     {
-        mStates = { };
-        mStates.reserve(512);
-        mStates.push_back(PosState());
+        mStates = std::vector<PosState>(MAX_OWN_STATES);
+        mNumStates = 1;
 
         std::vector<std::string> fenSplit = splitString(fen, ' ');
 
@@ -161,7 +239,9 @@ public:
             state().pliesSincePawnOrCapture = static_cast<u8>(stoi(fenSplit[4]));
 
         if (fenSplit.size() >= 6)
-            state().currentMoveCounter = static_cast<u16>(stoi(fenSplit[5]));
+            mFirstMoveCounter = static_cast<u16>(stoi(fenSplit[5]));
+
+        updateSliderAttacks(~0U, 0); // All sliders changed
 
         state().checkers = attackers(kingSquare()) & them();
     }
@@ -218,6 +298,9 @@ public:
 
     constexpr std::optional<Square> enPassantSquare() const
     {
+        if (state().enPassantSquare == Square::Count)
+            return std::nullopt;
+
         return state().enPassantSquare;
     }
 
@@ -231,6 +314,15 @@ public:
         state().pliesSincePawnOrCapture = newValue;
     }
 
+    // Full move counter, incremented after each black move
+    constexpr u16 currentMoveCounter() const
+    {
+        const size_t blackMoves
+            = (numStates() - 1 + (stateAt(0).colorToMove == Color::Black)) / 2;
+
+        return static_cast<u16>(mFirstMoveCounter + blackMoves);
+    }
+
     constexpr Move lastMove() const {
         return state().lastMove;
     }
@@ -239,12 +331,16 @@ public:
     {
         assert(n >= 1);
 
-        return n > mStates.size()
+        return n > numStates()
              ? MOVE_NONE
-             : Move(mStates[mStates.size() - n].lastMove);
+             : Move(stateAt(numStates() - n).lastMove);
     }
 
-    constexpr auto captured() const {
+    constexpr std::optional<PieceType> captured() const
+    {
+        if (state().captured == PieceType::Count)
+            return std::nullopt;
+
         return state().captured;
     }
 
@@ -280,14 +376,12 @@ public:
 
     constexpr std::optional<PieceType> pieceTypeAt(const Square square) const
     {
-        if (!isOccupied(square))
-            return std::nullopt;
+        const PieceType pt = state().pieceTypes[square];
 
-        for (const PieceType pt : EnumIter<PieceType>())
-            if (hasSquare(getBb(pt), square))
-                return pt;
+        if (pt == PieceType::Count)
+            return std::nullopt;
 
-        return std::nullopt;
+        return pt;
     }
 
     constexpr Square kingSquare(const Color color) const
@@ -310,6 +404,9 @@ private:
         state().colorBbs[color]      ^= squareBb(square);
         state().piecesBbs[pieceType] ^= squareBb(square);
 
+        state().pieceTypes[square]
+            = state().pieceTypes[square] == PieceType::Count ? pieceType : PieceType::Count;
+
         state().zobristHash ^= ZOBRIST_PIECES[color][pieceType][square];
 
         if (pieceType == PieceType::Pawn)
@@ -379,12 +476,10 @@ public:
 
         myFen += " ";
 
-        myFen += state().enPassantSquare.has_value()
-               ? squareToStr(*(state().enPassantSquare))
-               : "-";
+        myFen += enPassantSquare().has_value() ? squareToStr(*enPassantSquare()) : "-";
 
         myFen += " " + std::to_string(state().pliesSincePawnOrCapture);
-        myFen += " " + std::to_string(state().currentMoveCounter);
+        myFen += " " + std::to_string(currentMoveCounter());
 
         return myFen;
     }
@@ -419,8 +514,8 @@ public:
                   << state().zobristHash
                   << "\nMoves:";
 
-        for (size_t i = 1; i < mStates.size(); i++)
-            std::cout << " " << Move(mStates[i].lastMove).toUci();
+        for (size_t i = 1; i < numStates(); i++)
+            std::cout << " " << Move(stateAt(i).lastMove).toUci();
 
         std::cout << std::endl; // Flush
     }
@@ -450,20 +545,31 @@ public:
         if (!fnHasLegalMove(*this))
             return inCheck() ? GameState::Loss : GameState::Draw;
 
+        return isDraw(fnHasLegalMove, searchPly) ? GameState::Draw : GameState::Ongoing;
+    }
+
+    // Draw by 50-move rule, insufficient material or repetition
+    // Checkmate and stalemate aren't detected (search detects them in its moves loops),
+    // except that fnHasLegalMove is called if the 50-move rule is hit while in check,
+    // since checkmate takes precedence
+    constexpr bool isDraw(
+        bool (*fnHasLegalMove) (Position&),
+        const std::optional<size_t> searchPly = std::nullopt)
+    {
         if (state().pliesSincePawnOrCapture >= 100)
-            return GameState::Draw;
+            return !inCheck() || fnHasLegalMove(*this);
 
         const auto numPieces = std::popcount(occupied());
 
         // K vs K
         if (numPieces == 2)
-            return GameState::Draw;
+            return true;
         // KN vs K
         // KB vs K
         else if (numPieces == 3)
         {
             if (getBb(PieceType::Knight) > 0 || getBb(PieceType::Bishop) > 0)
-                return GameState::Draw;
+                return true;
         }
         // KNN vs K
         // KN vs KN
@@ -475,7 +581,7 @@ public:
             const auto numBlackKnights = std::popcount(getBb(Color::Black, PieceType::Knight));
 
             if (numWhiteKnights + numBlackKnights == 2)
-                return GameState::Draw;
+                return true;
 
             const auto numWhiteBishops = std::popcount(getBb(Color::White, PieceType::Bishop));
             const auto numBlackBishops = std::popcount(getBb(Color::Black, PieceType::Bishop));
@@ -483,15 +589,15 @@ public:
             if ((numWhiteKnights == 1 && numBlackBishops == 1)
             ||  (numBlackKnights == 1 && numWhiteBishops == 1)
             ||  (numWhiteBishops == 1 && numBlackBishops == 1))
-                return GameState::Draw;
+                return true;
         }
 
         // Repetition detection
 
-        if (mStates.size() <= 4 || state().pliesSincePawnOrCapture < 4)
-            return GameState::Ongoing;
+        if (numStates() <= 4 || state().pliesSincePawnOrCapture < 4)
+            return false;
 
-        const i32 numStates = static_cast<i32>(mStates.size());
+        const i32 numStates = static_cast<i32>(this->numStates());
         const i32 pliesSincePawnOrCapture = static_cast<i32>(state().pliesSincePawnOrCapture);
 
         const i32 stateIdxAfterPawnOrCapture
@@ -506,12 +612,12 @@ public:
         #pragma clang diagnostic ignored "-Wsign-conversion"
 
         for (i32 i = numStates - 3; i >= stateIdxAfterPawnOrCapture; i -= 2)
-            if (mStates[i].zobristHash == zobristHash() && (i > rootStateIdx || ++count == 2))
-                return GameState::Draw;
+            if (stateAt(i).zobristHash == zobristHash() && (i > rootStateIdx || ++count == 2))
+                return true;
 
         #pragma clang diagnostic pop // #pragma clang diagnostic ignored "-Wsign-conversion"
 
-        return GameState::Ongoing;
+        return false;
     }
 
     constexpr bool stmHasNonPawns() const
@@ -600,8 +706,8 @@ public:
     constexpr Bitboard pinned()
     {
         // Cached?
-        if (state().pinned.has_value())
-            return *(state().pinned);
+        if (state().pinnedCached)
+            return state().pinned;
 
         const Square kingSquare = this->kingSquare();
 
@@ -618,6 +724,7 @@ public:
             |= enemyRooksQueens & getRookAttacks(kingSquare, them());
 
         state().pinned = 0;
+        state().pinnedCached = true;
 
         ITERATE_BITBOARD(potentialAttackers, attackerSquare,
         {
@@ -625,10 +732,10 @@ public:
                 = us() & BETWEEN_EXCLUSIVE_BB[kingSquare][attackerSquare];
 
             if (std::popcount(maybePinned) == 1)
-                *(state().pinned) |= maybePinned;
+                state().pinned |= maybePinned;
         });
 
-        return *(state().pinned);
+        return state().pinned;
     }
 
     constexpr Bitboard attacks(const Color color, const Bitboard occ) const
@@ -667,21 +774,82 @@ public:
         return attacksBb;
     }
 
+    // Squares attacked by a color's pieces of a type
+    // For sliders, this is incrementally updated in makeMove(), or computed if not valid
+    constexpr Bitboard attacksBy(const Color color, const PieceType pieceType) const
+    {
+        const Bitboard pieces = getBb(color, pieceType);
+
+        switch (pieceType)
+        {
+        case PieceType::Pawn:
+        {
+            const Bitboard notFileA = ~fileBb(File::A);
+            const Bitboard notFileH = ~fileBb(File::H);
+
+            return color == Color::White
+                 ? ((pieces & notFileA) << 7) | ((pieces & notFileH) << 9)
+                 : ((pieces & notFileH) >> 7) | ((pieces & notFileA) >> 9);
+        }
+        case PieceType::Knight:
+        {
+            Bitboard attacksBb = 0;
+
+            ITERATE_BITBOARD(pieces, square,
+            {
+                attacksBb |= getKnightAttacks(square);
+            });
+
+            return attacksBb;
+        }
+        case PieceType::King:
+            return getKingAttacks(kingSquare(color));
+        default:
+            return state().sliderAttacksValid
+                 ? state().sliderAttacks[color][sliderIdx(pieceType)]
+                 : sliderAttacks(color, pieceType);
+        }
+    }
+
+    // Squares attacked by a color
     constexpr Bitboard attacks(const Color color) const
     {
-        return attacks(color, occupied());
+        Bitboard attacksBb = 0;
+
+        for (const PieceType pt : EnumIter<PieceType>())
+            attacksBb |= attacksBy(color, pt);
+
+        assert(attacksBb == attacks(color, occupied()));
+        return attacksBb;
     }
 
-    constexpr Bitboard enemyAttacksNoStmKing()
+    // Not cached, it is cheap to derive from the slider attack maps
+    constexpr Bitboard enemyAttacksNoStmKing() const
     {
-        // If not cached, calculate and cache
-        if (!state().enemyAttacksNoStmKing.has_value())
+        const Bitboard occNoStmKing = occupied() ^ squareBb(kingSquare());
+
+        if (!state().sliderAttacksValid)
+            return attacks(!sideToMove(), occNoStmKing);
+
+        Bitboard enemyAttacks = attacks(!sideToMove());
+
+        // Without our king, the enemy sliders checking it also attack the squares behind it
+
+        const Bitboard bishopsQueens = getBb(PieceType::Bishop) | getBb(PieceType::Queen);
+        const Bitboard rooksQueens   = getBb(PieceType::Rook)   | getBb(PieceType::Queen);
+
+        ITERATE_BITBOARD(checkers() & bishopsQueens, checkerSquare,
         {
-            const Bitboard occNoStmKing = occupied() ^ squareBb(kingSquare());
-            state().enemyAttacksNoStmKing = attacks(!sideToMove(), occNoStmKing);
-        }
+            enemyAttacks |= getBishopAttacks(checkerSquare, occNoStmKing);
+        });
+
+        ITERATE_BITBOARD(checkers() & rooksQueens, checkerSquare,
+        {
+            enemyAttacks |= getRookAttacks(checkerSquare, occNoStmKing);
+        });
 
-        return *(state().enemyAttacksNoStmKing);
+        assert(enemyAttacks == attacks(!sideToMove(), occNoStmKing));
+        return enemyAttacks;
     }
 
     constexpr Bitboard attackers(const Square square, const Bitboard occ) const
@@ -710,18 +878,93 @@ public:
         return attackers(square, occupied());
     }
 
+private:
+
+    // Index of a slider piece type in PosState::sliderAttacks
+    static constexpr size_t sliderIdx(const PieceType pieceType)
+    {
+        assert(pieceType == PieceType::Bishop
+            || pieceType == PieceType::Rook
+            || pieceType == PieceType::Queen);
+
+        return static_cast<size_t>(pieceType) - static_cast<size_t>(PieceType::Bishop);
+    }
+
+    // Bit of a color's slider piece type in updateSliderAttacks()'s changedSliders
+    // 0 if not a slider piece type
+    static constexpr u32 sliderBit(const Color color, const PieceType pieceType)
+    {
+        if (pieceType != PieceType::Bishop
+        &&  pieceType != PieceType::Rook
+        &&  pieceType != PieceType::Queen)
+            return 0;
+
+        return 1U << (static_cast<size_t>(color) * 3 + sliderIdx(pieceType));
+    }
+
+    // Computed from scratch
+    constexpr Bitboard sliderAttacks(const Color color, const PieceType pieceType) const
+    {
+        Bitboard attacksBb = 0;
+
+        ITERATE_BITBOARD(getBb(color, pieceType), square,
+        {
+            if (pieceType == PieceType::Bishop)
+                attacksBb |= getBishopAttacks(square, occupied());
+            else if (pieceType == PieceType::Rook)
+                attacksBb |= getRookAttacks(square, occupied());
+            else
+                attacksBb |= getQueenAttacks(square, occupied());
+        });
+
+        return attacksBb;
+    }
+
+    template<PieceType pieceType>
+    constexpr void updateSliderAttacks(
+        const Color color, const u32 changedSliders, const Bitboard changedSquares)
+    {
+        Bitboard& attacksBb = state().sliderAttacks[color][sliderIdx(pieceType)];
+
+        if ((changedSliders & sliderBit(color, pieceType)) != 0
+        || (attacksBb & changedSquares) != 0)
+            attacksBb = sliderAttacks(color, pieceType);
+    }
+
+    // Recomputes the attacks of the slider types in changedSliders (moved, captured or promoted),
+    // and of the slider types attacking a square whose occupancy changed
+    // (only those squares can have blocked or unblocked a slider's ray)
+    constexpr void updateSliderAttacks(const u32 changedSliders, const Bitboard changedSquares)
+    {
+        for (const Color color : EnumIter<Color>())
+        {
+            updateSliderAttacks<PieceType::Bishop>(color, changedSliders, changedSquares);
+            updateSliderAttacks<PieceType::Rook>  (color, changedSliders, changedSquares);
+            updateSliderAttacks<PieceType::Queen> (color, changedSliders, changedSquares);
+        }
+
+        assert(attacks(Color::White) == attacks(Color::White, occupied()));
+        assert(attacks(Color::Black) == attacks(Color::Black, occupied()));
+    }
+
+    // Specialized on the side to move, so that castling squares and colors are constants
+    template<Color stm, bool updateAttacks>
     constexpr void makeMove(const Move move)
     {
-        const PosState copy = state();
-        mStates.push_back(copy);
+        assert(stm == sideToMove());
 
-        const Color stm = sideToMove();
+        // The newest half of the states stays in the stack, so the make/undo line being played
+        // (e.g. a perft recursion) can still be undone after an overflow
+        if (mNumStates == MAX_OWN_STATES) [[unlikely]]
+            shareHistory(MAX_OWN_STATES / 2);
+
+        mStates[mNumStates] = mStates[mNumStates - 1];
+        mNumStates++;
 
         state().lastMove = move.asU16();
 
-        // These will be calculated and cached later
-        state().pinned = std::nullopt;
-        state().enemyAttacksNoStmKing = std::nullopt;
+        // This will be calculated and cached later
+        state().pinnedCached = false;
 
         if (!move)
         {
@@ -730,19 +973,14 @@ public:
             state().colorToMove = !stm;
             state().zobristHash ^= ZOBRIST_COLOR;
 
-            if (state().enPassantSquare.has_value())
+            if (state().enPassantSquare != Square::Count)
             {
-                const Square enPassantSquare = *(state().enPassantSquare);
-                state().enPassantSquare = std::nullopt;
-                state().zobristHash ^= ZOBRIST_FILES[squareFile(enPassantSquare)];
+                state().zobristHash ^= ZOBRIST_FILES[squareFile(state().enPassantSquare)];
+                state().enPassantSquare = Square::Count;
             }
 
             state().pliesSincePawnOrCapture++;
-
-            if (stm == Color::Black)
-                state().currentMoveCounter++;
-
-            state().captured = std::nullopt;
+            state().captured = PieceType::Count;
             return;
         }
 
@@ -751,6 +989,10 @@ public:
         const MoveFlag  moveFlag  = move.flag();
         const PieceType pieceType = move.pieceType();
 
+        // For the attacks update
+        u32 changedSliders = sliderBit(stm, pieceType);
+        Bitboard changedSquares = squareBb(from) | squareBb(to);
+
         togglePiece(stm, pieceType, from);
 
         if (moveFlag == MoveFlag::Castling)
@@ -762,23 +1004,47 @@ public:
             togglePiece(stm, PieceType::Rook, rookFrom);
             togglePiece(stm, PieceType::Rook, rookTo);
 
-            state().captured = std::nullopt;
+            changedSliders |= sliderBit(stm, PieceType::Rook);
+            changedSquares |= squareBb(rookFrom) | squareBb(rookTo);
+
+            state().captured = PieceType::Count;
         }
         else if (moveFlag == MoveFlag::EnPassant)
         {
             togglePiece(!stm, PieceType::Pawn, enPassantRelative(to));
             togglePiece(stm, PieceType::Pawn, to);
 
+            changedSquares |= squareBb(enPassantRelative(to));
+
             state().captured = PieceType::Pawn;
         }
         else {
-            state().captured = pieceTypeAt(to);
+            state().captured = state().pieceTypes[to];
+
+            if (state().captured != PieceType::Count)
+            {
+                togglePiece(!stm, state().captured, to);
+                changedSliders |= sliderBit(!stm, state().captured);
+            }
 
-            if (state().captured.has_value())
-                togglePiece(!stm, *(state().captured), to);
+            const PieceType pieceTypeTo = move.promotion().value_or(pieceType);
+            togglePiece(stm, pieceTypeTo, to);
+            changedSliders |= sliderBit(stm, pieceTypeTo);
+        }
+
+        if constexpr (updateAttacks)
+        {
+            // Stale since a makeMove<false>()? Then recompute all of them
+            if (!state().sliderAttacksValid)
+            {
+                changedSliders = ~0U;
+                state().sliderAttacksValid = true;
+            }
 
-            togglePiece(stm, move.promotion().value_or(pieceType), to);
+            updateSliderAttacks(changedSliders, changedSquares);
         }
+        else
+            state().sliderAttacksValid = false;
 
         state().zobristHash ^= state().castlingRights; // XOR old castling rights out
 
@@ -798,11 +1064,10 @@ public:
         state().zobristHash ^= state().castlingRights; // XOR new castling rights in
 
         // Remove old en passant square if one exists
-        if (state().enPassantSquare.has_value())
+        if (state().enPassantSquare != Square::Count)
         {
-            const Square enPassantSquare = *(state().enPassantSquare);
-            state().enPassantSquare = std::nullopt;
-            state().zobristHash ^= ZOBRIST_FILES[squareFile(enPassantSquare)];
+            state().zobristHash ^= ZOBRIST_FILES[squareFile(state().enPassantSquare)];
+            state().enPassantSquare = Square::Count;
         }
 
         // If pawn double push, create new en passant square
@@ -816,21 +1081,69 @@ public:
         state().colorToMove = !stm;
         state().zobristHash ^= ZOBRIST_COLOR;
 
-        if (pieceType == PieceType::Pawn || state().captured.has_value())
+        if (pieceType == PieceType::Pawn || state().captured != PieceType::Count)
             state().pliesSincePawnOrCapture = 0;
         else
             state().pliesSincePawnOrCapture++;
 
-        if (stm == Color::Black)
-            state().currentMoveCounter++;
+        state().checkers = attackers(kingSquare(!stm)) & getBb(stm);
+    }
 
-        state().checkers = attackers(kingSquare()) & them();
+public:
+
+    // makeMove<false>() skips the slider attack maps update, for perft, which barely uses them
+    // They are then computed from scratch when needed, until a makeMove<true>() recomputes them
+    template<bool updateAttacks = true>
+    constexpr void makeMove(const Move move)
+    {
+        PROFILE_SCOPE(MakeMove);
+
+        if (sideToMove() == Color::White)
+            makeMove<Color::White, updateAttacks>(move);
+        else
+            makeMove<Color::Black, updateAttacks>(move);
     }
 
     constexpr void undoMove()
     {
-        assert(mStates.size() > 1);
-        mStates.pop_back();
+        PROFILE_SCOPE(UndoMove);
+
+        assert(mNumStates > 1);
+        mNumStates--;
+    }
+
+    // Move every state but the newest numStatesKept ones to a new history shared by copies of
+    // this position
+    // The moves before the oldest kept state can no longer be undone
+    inline void shareHistory(const size_t numStatesKept = 1)
+    {
+        assert(numStatesKept >= 1);
+
+        if (mNumStates <= numStatesKept) return;
+
+        const size_t numStatesMoved = mNumStates - numStatesKept;
+
+        auto history = std::make_shared<std::vector<PosState>>();
+        history->reserve(mHistorySize + numStatesMoved);
+        history->insert(history->end(), mHistory, mHistory + mHistorySize);
+
+        history->insert(
+            history->end(),
+            mStates.begin(),
+            mStates.begin() + static_cast<std::ptrdiff_t>(numStatesMoved)
+        );
+
+        std::copy(
+            mStates.begin() + static_cast<std::ptrdiff_t>(numStatesMoved),
+            mStates.begin() + static_cast<std::ptrdiff_t>(mNumStates),
+            mStates.begin()
+        );
+
+        mNumStates = numStatesKept;
+
+        mHistory = history->data();
+        mHistorySize = history->size();
+        mHistoryOwner = std::move(history);
     }
 
     inline Move uciToMove(const std::string uciMove) const
@@ -881,6 +1194,8 @@ public:
     // Static Exchange Evaluation
     constexpr bool SEE(const Move move, const i32 threshold = 0) const
     {
+        PROFILE_SCOPE(SEE);
+
         assert(move);
 
         CONSTEXPR_OR_CONST EnumArray<i32, PieceType> PIECES_VALUES = {
@@ -970,10 +1285,10 @@ public:
     constexpr bool hasUpcomingRepetition(
         const std::optional<size_t> searchPly = std::nullopt) const
     {
-        if (mStates.size() <= 3 || state().pliesSincePawnOrCapture < 3)
+        if (numStates() <= 3 || state().pliesSincePawnOrCapture < 3)
             return false;
 
-        const i32 numStates = static_cast<i32>(mStates.size());
+        const i32 numStates = static_cast<i32>(this->numStates());
         const i32 pliesSincePawnOrCapture = static_cast<i32>(state().pliesSincePawnOrCapture);
 
         const i32 stateIdxAfterPawnOrCapture
@@ -983,7 +1298,7 @@ public:
             = searchPly.has_value() ? numStates - static_cast<i32>(*searchPly) - 1 : -1;
 
         u64 otherHash = state().zobristHash
-                      ^ mStates[mStates.size() - 2].zobristHash
+                      ^ stateAt(this->numStates() - 2).zobristHash
                       ^ ZOBRIST_COLOR;
 
         #pragma clang diagnostic push
@@ -991,13 +1306,13 @@ public:
 
         for (i32 stateIdx = numStates - 4; stateIdx >= stateIdxAfterPawnOrCapture; stateIdx -= 2)
         {
-            otherHash ^= mStates[stateIdx + 1].zobristHash;
-            otherHash ^= mStates[stateIdx].zobristHash;
+            otherHash ^= stateAt(stateIdx + 1).zobristHash;
+            otherHash ^= stateAt(stateIdx).zobristHash;
             otherHash ^= ZOBRIST_COLOR;
 
             if (otherHash != 0) continue;
 
-            const u64 moveHash = state().zobristHash ^ mStates[stateIdx].zobristHash;
+            const u64 moveHash = state().zobristHash ^ stateAt(stateIdx).zobristHash;
             size_t cuckooIdx;
 
             if ((cuckooIdx = h1(moveHash), CUCKOO_DATA.hashes[cuckooIdx] != moveHash)
@@ -1015,7 +1330,7 @@ public:
 
             // At and before root, do 3-fold repetition
             for (i32 j = stateIdx - 2; j >= stateIdxAfterPawnOrCapture; j -= 2)
-                if (mStates[stateIdx].zobristHash == mStates[j].zobristHash)
+                if (stateAt(stateIdx).zobristHash == stateAt(j).zobristHash)
                     return true;
         }
 
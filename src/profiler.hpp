@@ -0,0 +1,196 @@
+// clang-format off
+
+#pragma once
+
+#include "utils.hpp"
+#include <memory>
+#include <mutex>
+#include <iomanip>
+
+#if defined(PROFILE) && (defined(__x86_64__) || defined(__i386__))
+    #include <x86intrin.h>
+#endif
+
+// Scoped timers of engine subsystems, only compiled with -DPROFILE (make profile)
+// PROFILE_SCOPE(Zone) times the rest of the enclosing scope in the calling thread
+// Without -DPROFILE, PROFILE_SCOPE expands to nothing
+
+namespace profiler {
+
+#if defined(PROFILE)
+    constexpr bool ENABLED = true;
+#else
+    constexpr bool ENABLED = false;
+#endif
+
+enum class Zone : i32 {
+    Search, MoveGen, Legality, MakeMove, UndoMove, SEE, AccUpdate, Evaluate, TTProbe, Count
+};
+
+inline std::string zoneName(const Zone zone)
+{
+    switch (zone) {
+        case Zone::Search:    return "search";
+        case Zone::MoveGen:   return "movegen";
+        case Zone::Legality:  return "legality";
+        case Zone::MakeMove:  return "makemove";
+        case Zone::UndoMove:  return "undomove";
+        case Zone::SEE:       return "SEE";
+        case Zone::AccUpdate: return "acc update";
+        case Zone::Evaluate:  return "evaluate";
+        case Zone::TTProbe:   return "TT probe";
+        default:              return "";
+    }
+}
+
+// Timestamp counter ticks (nanoseconds if not x86)
+inline u64 ticks()
+{
+    #if defined(PROFILE) && (defined(__x86_64__) || defined(__i386__))
+        return __rdtsc();
+    #else
+        return static_cast<u64>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()
+        ).count());
+    #endif
+}
+
+struct ThreadProfile
+{
+public:
+
+    EnumArray<u64, Zone> ticks = { };
+    EnumArray<u64, Zone> calls = { };
+
+}; // struct ThreadProfile
+
+// Profiles of every thread that ever profiled something
+// Never freed, so that profiles of exited threads are still aggregated
+inline std::mutex registryMutex;
+inline std::vector<std::unique_ptr<ThreadProfile>> registry = { };
+
+inline ThreadProfile& threadProfile()
+{
+    thread_local ThreadProfile* profile = [] ()
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        registry.push_back(std::make_unique<ThreadProfile>());
+        return registry.back().get();
+    }();
+
+    return *profile;
+}
+
+class Scope
+{
+private:
+
+    Zone mZone;
+    u64 mStart;
+
+public:
+
+    inline Scope(const Zone zone) : mZone(zone), mStart(ticks()) { }
+
+    inline ~Scope()
+    {
+        ThreadProfile& profile = threadProfile();
+        profile.ticks[mZone] += ticks() - mStart;
+        profile.calls[mZone]++;
+    }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+}; // class Scope
+
+// Only call while no thread is profiling
+inline void reset()
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+
+    for (std::unique_ptr<ThreadProfile>& profile : registry)
+        *profile = { };
+}
+
+// Sums of all threads
+// Only call while no thread is profiling
+inline ThreadProfile totalProfile()
+{
+    ThreadProfile total = { };
+
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+
+        for (const std::unique_ptr<ThreadProfile>& profile : registry)
+            for (const Zone zone : EnumIter<Zone>())
+            {
+                total.ticks[zone] += profile->ticks[zone];
+                total.calls[zone] += profile->calls[zone];
+            }
+    }
+
+    return total;
+}
+
+// Zones can be nested (e.g. SEE in move picking inside search), so percentages don't add up
+// Only call while no thread is profiling
+inline void print()
+{
+    const ThreadProfile total = totalProfile();
+
+    const u64 searchTicks = std::max<u64>(total.ticks[Zone::Search], 1);
+
+    const std::ios_base::fmtflags oldFlags = std::cout.flags();
+    const std::streamsize oldPrecision = std::cout.precision();
+
+    std::cout << std::fixed << std::setprecision(2)
+              << std::left << std::setw(12) << "zone" << std::right
+              << std::setw(14) << "calls"
+              << std::setw(16) << "Mticks"
+              << std::setw(14) << "ticks/call"
+              << std::setw(10) << "search%"
+              << std::endl;
+
+    for (const Zone zone : EnumIter<Zone>())
+    {
+        const double zoneTicks = static_cast<double>(total.ticks[zone]);
+
+        std::cout << std::left << std::setw(12) << zoneName(zone) << std::right
+                  << std::setw(14) << total.calls[zone]
+                  << std::setw(16) << zoneTicks / 1'000'000.0
+                  << std::setw(14)
+                  << zoneTicks / static_cast<double>(std::max<u64>(total.calls[zone], 1))
+                  << std::setw(9) << zoneTicks * 100.0 / static_cast<double>(searchTicks)
+                  << "%" << std::endl;
+    }
+
+    std::cout.flags(oldFlags);
+    std::cout.precision(oldPrecision);
+}
+
+// Calls and ticks of each zone, as a JSON object without a newline
+// Only call while no thread is profiling
+inline void printJson()
+{
+    const ThreadProfile total = totalProfile();
+
+    std::cout << "{";
+
+    for (const Zone zone : EnumIter<Zone>())
+        std::cout << (zone != Zone::Search ? "," : "")
+                  << "\"" << zoneName(zone) << "\":{"
+                  << "\"calls\":" << total.calls[zone]
+                  << ",\"ticks\":" << total.ticks[zone]
+                  << "}";
+
+    std::cout << "}";
+}
+
+} // namespace profiler
+
+#if defined(PROFILE)
+    #define PROFILE_SCOPE(zone) const profiler::Scope profileScope(profiler::Zone::zone)
+#else
+    #define PROFILE_SCOPE(zone)
+#endif
@@ -12,22 +12,47 @@
 #include "thread_data.hpp"
 #include "move_picker.hpp"
 #include "cuckoo.hpp"
+#include "abdada.hpp"
+#include "telemetry.hpp"
+#include "numa.hpp"
 #include <atomic>
 #include <cstring>
+#include <memory>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <future>
 
 enum class NodeType : i32 {
     PV, Cut, All
 };
 
+enum class SmpMode : i32 {
+    LazySMP, ABDADA
+};
+
+// Lazy SMP depth skipping
+// Helper thread i skips depths based on SKIP_SIZE[(i - 1) % 20] and SKIP_PHASE[(i - 1) % 20]
+// so that threads are spread across different depths
+constexpr std::array<i32, 20> SKIP_SIZE = {
+    1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4
+};
+
+constexpr std::array<i32, 20> SKIP_PHASE = {
+    0, 1, 0, 1, 2, 3, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 6, 7
+};
+
+// With spin wait enabled, idle threads busy-wait this long before sleeping
+constexpr u64 SPIN_WAIT_MICROSECONDS = 1000;
+
 struct SearchConfig
 {
 public:
 
     i32 maxDepth = MAX_DEPTH;
 
+    // Hard nodes limit (total nodes of all threads)
+    // Exact with 1 thread, otherwise overshot by less than 1024 nodes per thread
     std::optional<u64> maxNodes = std::nullopt;
 
     std::chrono::time_point<std::chrono::steady_clock> startTime
@@ -36,10 +61,38 @@ public:
     std::optional<u64> hardMs = std::nullopt;
     std::optional<u64> softMs = std::nullopt;
 
+    // Nodestime mode (nodes per millisecond, 0 if disabled)
+    // Time limits are checked against nodes searched instead of wall clock time
+    u64 nodesTime = 0;
+
+    size_t multiPV = 1; // Number of PV lines to search and print
+
+    SmpMode smpMode = SmpMode::LazySMP;
+
+    // If not empty, only these root moves are searched ("go searchmoves")
+    ArrayVec<Move, 256> searchMoves = { };
+
     bool printInfo = true;
 
 }; // struct SearchConfig
 
+// Thread pool latencies in nanoseconds
+// Start: from search config's start time until the last thread starts searching
+// Stop: from the search being stopped until all threads are done
+struct LatencyStats
+{
+public:
+
+    u64 numSearches = 0;
+
+    u64 totalStartNs = 0;
+    u64 maxStartNs   = 0;
+
+    u64 totalStopNs = 0;
+    u64 maxStopNs   = 0;
+
+}; // struct LatencyStats
+
 class Searcher
 {
 private:
@@ -51,6 +104,49 @@ private:
 
     std::atomic<bool> mStopSearch = false;
 
+    // Thread pool
+    // Threads sleep until mSearchId changes, then search and decrement mNumThreadsSearching
+
+    std::mutex mPoolMutex;
+    std::condition_variable mWakeCv; // Notified to start a search or exit threads
+    std::condition_variable mDoneCv; // Notified when all threads are done searching
+
+    std::atomic<u64> mSearchId = 0; // Only modified with mPoolMutex locked
+    size_t mNumThreadsSearching = 0;
+
+    std::atomic<bool> mSpinWait = false;
+
+    std::atomic<u64> mStartLatencyNs = 0;
+    std::chrono::steady_clock::time_point mStopTime;
+    LatencyStats mLatencyStats = { };
+
+    SearchStats mStats = { }; // Of last search, all threads
+
+    // Of last search
+    u64 mSearchMs = 0;
+    u64 mStopLatencyNs = 0;
+
+    TelemetryWriter mTelemetry;
+
+    // Root state, copied by every thread when it starts searching
+    Position mRootPos;
+    nnue::BothAccumulators mRootBothAccs;
+    std::unique_ptr<nnue::FinnyTable> mRootFinnyTable = std::make_unique<nnue::FinnyTable>();
+    std::vector<RootMove> mRootMoves = { };
+
+    AbdadaTable mAbdadaTable;
+    bool mAbdada = false; // ABDADA enabled in current search?
+
+    // Per-thread histories, or a single one shared by all threads
+    std::vector<std::unique_ptr<Histories>> mHistories = { };
+    bool mSharedHistories = false;
+
+    // Pin threads to CPUs, spread across NUMA nodes
+    // With multiple nodes, each node gets its own copy of the net and the TT is interleaved
+    bool mNumaAffinity = false;
+    std::vector<numa::Node> mNumaNodes = { }; // Read once when NumaAffinity is enabled
+    std::vector<std::unique_ptr<nnue::Net>> mNetReplicas = { }; // [numaNode]
+
     constexpr const ThreadData* mainThreadData() const
     {
         assert(!mThreadsData.empty());
@@ -69,7 +165,7 @@ public:
 
     inline Searcher() {
         setThreads(1);
-        resizeTT(mTT, 32); // Default TT size is 32 MiB
+        resizeTT(32); // Default TT size is 32 MiB
     }
 
     inline ~Searcher() {
@@ -80,23 +176,18 @@ public:
     {
         blockUntilSleep();
 
-        // Remove threads
-        while (!mThreadsData.empty())
+        // Remove threads, newest first
+        while (mThreadsData.size() > numThreads)
         {
             ThreadData* td = mThreadsData.back();
 
-            wakeThread(td, ThreadState::ExitAsap);
-
             {
-                std::unique_lock<std::mutex> lock(td->mutex);
-
-                td->cv.wait(lock, [td] {
-                    return td->threadState == ThreadState::Exited;
-                });
+                std::lock_guard<std::mutex> lock(mPoolMutex);
+                td->exitAsap = true;
             }
 
-            if (mNativeThreads.back().joinable())
-                mNativeThreads.back().join();
+            mWakeCv.notify_all();
+            mNativeThreads.back().join();
 
             mNativeThreads.pop_back();
             delete td, mThreadsData.pop_back();
@@ -105,33 +196,207 @@ public:
         mThreadsData.reserve(numThreads);
         mNativeThreads.reserve(numThreads);
 
+        if (mThreadsData.empty())
+        {
+            mNetReplicas.clear();
+            mNetReplicas.resize(mNumaNodes.size() > 1 ? mNumaNodes.size() : 0);
+        }
+
         // Add threads
         while (mThreadsData.size() < numThreads)
         {
-            ThreadData* td = new ThreadData();
-            std::thread nativeThread([=, this]() mutable { loopThread(td); });
+            const size_t threadId = mThreadsData.size();
+            const u64 searchId = mSearchId.load(std::memory_order_relaxed);
+
+            std::promise<ThreadData*> tdPromise;
+            std::future<ThreadData*> tdFuture = tdPromise.get_future();
+
+            std::thread nativeThread(
+                [this, threadId, searchId, tdPromise = std::move(tdPromise)] () mutable
+            {
+                const nnue::Net* net = nnue::NET;
+
+                // Pin thread, spreading threads across NUMA nodes, then across each node's CPUs
+                if (!mNumaNodes.empty())
+                {
+                    const size_t node = threadId % mNumaNodes.size();
+                    const std::vector<size_t>& cpus = mNumaNodes[node].cpus;
+
+                    numa::pinThisThread(cpus[threadId / mNumaNodes.size() % cpus.size()]);
 
-            mThreadsData.push_back(td);
+                    // First thread of this node copies the net to this node's memory
+                    if (!mNetReplicas.empty())
+                    {
+                        if (mNetReplicas[node] == nullptr)
+                            mNetReplicas[node] = std::make_unique<nnue::Net>(*nnue::NET);
+
+                        net = mNetReplicas[node].get();
+                    }
+                }
+
+                // Allocate thread data in this thread so that its memory
+                // is placed in this thread's NUMA node (first touch)
+                ThreadData* td = new ThreadData();
+                td->threadId = threadId;
+                td->net = net;
+
+                tdPromise.set_value(td);
+                loopThread(td, searchId);
+            });
+
+            mThreadsData.push_back(tdFuture.get());
             mNativeThreads.push_back(std::move(nativeThread));
         }
 
         mThreadsData.shrink_to_fit();
         mNativeThreads.shrink_to_fit();
+
+        assignHistories();
+    }
+
+    inline void setNumaAffinity(const bool numaAffinity)
+    {
+        // Recreate all threads
+        const size_t numThreads = mThreadsData.size();
+        setThreads(0);
+        mNumaAffinity = numaAffinity;
+        mNumaNodes = mNumaAffinity ? numa::allowedNodes() : std::vector<numa::Node>();
+        setThreads(numThreads);
+
+        if (mNumaAffinity)
+            numa::interleave(mTT.data(), mTT.size() * sizeof(TTEntry), mNumaNodes);
+    }
+
+    constexpr size_t numNetReplicas() const {
+        return mNetReplicas.size();
+    }
+
+    inline void resizeTT(const size_t newMebibytes)
+    {
+        blockUntilSleep();
+        ::resizeTT(mTT, newMebibytes);
+
+        if (mNumaAffinity)
+            numa::interleave(mTT.data(), mTT.size() * sizeof(TTEntry), mNumaNodes);
+    }
+
+    inline void setSpinWait(const bool spinWait) {
+        mSpinWait.store(spinWait, std::memory_order_relaxed);
+    }
+
+    constexpr const LatencyStats& latencyStats() const {
+        return mLatencyStats;
+    }
+
+    constexpr void resetLatencyStats() {
+        mLatencyStats = { };
+    }
+
+    constexpr const SearchStats& stats() const {
+        return mStats;
+    }
+
+    // Empty file path disables telemetry
+    inline void setTelemetryFile(const std::string& filePath) {
+        mTelemetry.setFile(filePath);
+    }
+
+    // Writes every queued telemetry record before returning
+    inline void flushTelemetry() {
+        mTelemetry.flush();
+    }
+
+    // Queues a JSON record of the last search to the telemetry file, if enabled
+    // Call after printing bestmove, the record is written by a background thread
+    inline void writeTelemetry(const Move bestMove)
+    {
+        if (!mTelemetry.enabled() || !bestMove) return;
+
+        const auto optionalToJson = [] (const std::optional<u64> value) {
+            return value.has_value() ? std::to_string(*value) : "null";
+        };
+
+        const ThreadData* bestTd = bestThreadData();
+        const u64 nodes = totalNodes();
+
+        size_t abortedIterations = 0;
+
+        std::ostringstream threadsJson;
+
+        for (const ThreadData* td : mThreadsData)
+        {
+            const u64 threadNodes = td->nodes.load(std::memory_order_relaxed);
+
+            // An iteration was aborted if the search stopped during it
+            const bool aborted = td->rootDepth <= mSearchConfig.maxDepth
+                              && td->rootDepth > td->completedDepth;
+
+            abortedIterations += aborted;
+
+            threadsJson << (td == mainThreadData() ? "" : ",")
+                        << "{\"id\":" << td->threadId
+                        << ",\"depth\":" << td->completedDepth
+                        << ",\"nodes\":" << threadNodes
+                        << ",\"nps\":" << getNps(threadNodes, mSearchMs)
+                        << ",\"aborted\":" << (aborted ? "true" : "false")
+                        << "}";
+        }
+
+        std::ostringstream record;
+
+        record << "{\"fen\":\"" << mRootPos.fen() << "\""
+               << ",\"bestmove\":\"" << bestMove.toUci() << "\""
+               << ",\"score\":" << bestTd->rootMoves[0].score
+               << ",\"depth\":" << bestTd->completedDepth
+               << ",\"seldepth\":" << bestTd->rootMoves[0].selDepth
+               << ",\"limits\":{"
+               << "\"depth\":" << mSearchConfig.maxDepth
+               << ",\"nodes\":" << optionalToJson(mSearchConfig.maxNodes)
+               << ",\"hard_ms\":" << optionalToJson(mSearchConfig.hardMs)
+               << ",\"soft_ms\":" << optionalToJson(mSearchConfig.softMs)
+               << ",\"nodestime\":" << mSearchConfig.nodesTime
+               << "}"
+               << ",\"time_ms\":" << mSearchMs
+               << ",\"nodes\":" << nodes
+               << ",\"nps\":" << getNps(nodes, mSearchMs)
+               << ",\"start_latency_us\":"
+               << mStartLatencyNs.load(std::memory_order_relaxed) / 1000
+               << ",\"stop_latency_us\":" << mStopLatencyNs / 1000
+               << ",\"aborted_iterations\":" << abortedIterations
+               << ",\"threads\":[" << threadsJson.str() << "]"
+               << "}";
+
+        mTelemetry.push(record.str());
+    }
+
+    inline void setSharedHistories(const bool sharedHistories)
+    {
+        blockUntilSleep();
+        mSharedHistories = sharedHistories;
+        assignHistories();
+    }
+
+    // Memory used by histories in bytes
+    constexpr size_t historiesBytes() const {
+        return mHistories.size() * sizeof(Histories);
     }
 
     constexpr void ucinewgame()
     {
         for (ThreadData* td : mThreadsData)
-        {
             td->nodes.store(0, std::memory_order_relaxed);
-            td->historyTable     = { };
-            td->pawnsCorrHist    = { };
-            td->nonPawnsCorrHist = { };
-        }
+
+        for (std::unique_ptr<Histories>& histories : mHistories)
+            *histories = { };
 
         std::memset(mTT.data(), 0, mTT.size() * sizeof(TTEntry));
     }
 
+    // Of main thread in last search
+    constexpr i32 completedDepth() const {
+        return mainThreadData()->completedDepth;
+    }
+
     constexpr u64 totalNodes() const
     {
         u64 nodes = 0;
@@ -157,23 +422,41 @@ public:
 
         mSearchConfig.maxDepth = std::clamp<i32>(mSearchConfig.maxDepth, 1, MAX_DEPTH);
 
-        // Init main thread's position
-        mainThreadData()->pos = pos;
+        // Init root moves
+
+        std::vector<RootMove> rootMoves = { };
+
+        for (const Move move : legalMoves<MoveGenType::AllMoves>(pos))
+            rootMoves.push_back(RootMove(move));
+
+        const auto isNotSearchMove = [&] (const RootMove& rootMove) constexpr {
+            return !mSearchConfig.searchMoves.contains(rootMove.move);
+        };
 
-        // Init main thread's root accumulator
-        nnue::BothAccumulators& bothAccs = mainThreadData()->bothAccsStack[0];
-        bothAccs = nnue::BothAccumulators(pos);
+        // "go searchmoves": only search those moves (ignored if none of them is legal)
+        if (!std::all_of(rootMoves.begin(), rootMoves.end(), isNotSearchMove))
+            std::erase_if(rootMoves, isNotSearchMove);
+
+        mSearchConfig.multiPV = std::clamp<size_t>(mSearchConfig.multiPV, 1, rootMoves.size());
+
+        // Init root state
+
+        // Threads copy only the root state, the game history before it is shared
+        mRootPos = pos;
+        mRootPos.shareHistory();
+
+        mRootMoves = rootMoves;
+        mRootBothAccs = nnue::BothAccumulators(pos);
 
         const auto initFinnyEntry = [&] (
             const Color color, const bool mirrorVAxis, const size_t inputBucket) constexpr
         {
-            nnue::FinnyTableEntry& finnyEntry
-                = mainThreadData()->finnyTable[color][mirrorVAxis][inputBucket];
+            nnue::FinnyTableEntry& finnyEntry = (*mRootFinnyTable)[color][mirrorVAxis][inputBucket];
 
-            if (mirrorVAxis == bothAccs.mMirrorVAxis[color]
-            &&  inputBucket == bothAccs.mInputBucket[color])
+            if (mirrorVAxis == mRootBothAccs.mMirrorVAxis[color]
+            &&  inputBucket == mRootBothAccs.mInputBucket[color])
             {
-                finnyEntry.accumulator = bothAccs.mAccumulators[color];
+                finnyEntry.accumulator = mRootBothAccs.mAccumulators[color];
                 finnyEntry.colorBbs  = pos.colorBbs();
                 finnyEntry.piecesBbs = pos.piecesBbs();
             }
@@ -184,90 +467,249 @@ public:
             }
         };
 
-        // Init main thread's finny table
+        // Init root finny table
         for (const Color color : EnumIter<Color>())
             for (const bool mirrorVAxis : { false, true })
                 for (size_t inputBucket = 0; inputBucket < nnue::NUM_INPUT_BUCKETS; inputBucket++)
                     initFinnyEntry(color, mirrorVAxis, inputBucket);
 
-        // Init position, root accumulator and finny table of secondary threads
-        for (size_t i = 1; i < mThreadsData.size(); i++)
+        mStopSearch.store(false, std::memory_order_relaxed);
+        mStartLatencyNs.store(0, std::memory_order_relaxed);
+
+        mAbdada = mSearchConfig.smpMode == SmpMode::ABDADA && mThreadsData.size() > 1;
+
+        // Wake all threads at once
         {
-            mThreadsData[i]->pos = pos;
-            mThreadsData[i]->bothAccsStack[0] = bothAccs;
-            mThreadsData[i]->finnyTable = mainThreadData()->finnyTable;
+            std::lock_guard<std::mutex> lock(mPoolMutex);
+            mNumThreadsSearching = mThreadsData.size();
+            mSearchId.fetch_add(1, std::memory_order_release);
         }
 
-        mStopSearch.store(false, std::memory_order_relaxed);
+        mWakeCv.notify_all();
 
-        for (ThreadData* td : mThreadsData)
+        blockUntilSleep();
+
+        // Aggregate search stats of all threads
+        if constexpr (STATS_ENABLED)
         {
-            td->pliesData[0] = { };
-            td->pliesData[0].inCheck = td->pos.inCheck();
-            td->nodesByMove = { };
-            td->bothAccsIdx = 0;
+            mStats = { };
 
-            wakeThread(td, ThreadState::Searching);
+            for (const ThreadData* td : mThreadsData)
+                mStats.add(td->stats);
         }
 
-        blockUntilSleep();
+        // Update latency stats
+
+        const u64 startLatencyNs = mStartLatencyNs.load(std::memory_order_relaxed);
+        const u64 stopLatencyNs  = nanosecondsElapsed(mStopTime);
+
+        mSearchMs = millisecondsElapsed(mSearchConfig.startTime);
+        mStopLatencyNs = stopLatencyNs;
+
+        mLatencyStats.numSearches++;
+        mLatencyStats.totalStartNs += startLatencyNs;
+        mLatencyStats.maxStartNs = std::max<u64>(mLatencyStats.maxStartNs, startLatencyNs);
+        mLatencyStats.totalStopNs += stopLatencyNs;
+        mLatencyStats.maxStopNs = std::max<u64>(mLatencyStats.maxStopNs, stopLatencyNs);
 
-        return bestMoveAtRoot(mainThreadData());
+        return bestMoveAtRoot(bestThreadData());
     }
 
 private:
 
-    inline void loopThread(ThreadData* td)
+    inline void assignHistories()
     {
-        while (true) {
-            std::unique_lock<std::mutex> lock(td->mutex);
+        const size_t numHistories = mSharedHistories
+                                  ? std::min<size_t>(mThreadsData.size(), 1)
+                                  : mThreadsData.size();
 
-            td->cv.wait(lock, [&] {
-                return td->threadState != ThreadState::Sleeping;
+        mHistories.resize(numHistories);
+
+        for (size_t i = 0; i < mThreadsData.size(); i++)
+        {
+            std::unique_ptr<Histories>& histories = mHistories[mSharedHistories ? 0 : i];
+
+            if (histories == nullptr)
+                histories = std::make_unique<Histories>();
+
+            mThreadsData[i]->histories = histories.get();
+        }
+    }
+
+    inline void loopThread(ThreadData* td, u64 lastSearchId)
+    {
+        while (true)
+        {
+            // Briefly busy-wait, so that back-to-back searches start faster
+            if (mSpinWait.load(std::memory_order_relaxed))
+            {
+                const auto spinStart = std::chrono::steady_clock::now();
+
+                while (mSearchId.load(std::memory_order_acquire) == lastSearchId
+                && std::chrono::steady_clock::now() - spinStart
+                   < std::chrono::microseconds(SPIN_WAIT_MICROSECONDS))
+                    std::this_thread::yield();
+            }
+
+            std::unique_lock<std::mutex> lock(mPoolMutex);
+
+            mWakeCv.wait(lock, [&] {
+                return td->exitAsap || mSearchId.load(std::memory_order_relaxed) != lastSearchId;
             });
 
-            if (td->threadState == ThreadState::Searching)
-                iterativeDeepening(td);
-            else if (td->threadState == ThreadState::ExitAsap)
-                break;
+            if (td->exitAsap) return;
+
+            lastSearchId = mSearchId.load(std::memory_order_relaxed);
+            lock.unlock();
+
+            initThread(td);
+            iterativeDeepening(td);
 
-            td->threadState = ThreadState::Sleeping;
-            td->cv.notify_one();
+            lock.lock();
+
+            if (--mNumThreadsSearching == 0)
+                mDoneCv.notify_all();
         }
+    }
 
-        std::unique_lock<std::mutex> lock(td->mutex);
-        td->threadState = ThreadState::Exited;
-        lock.unlock();
-        td->cv.notify_all();
+    inline void blockUntilSleep()
+    {
+        std::unique_lock<std::mutex> lock(mPoolMutex);
+
+        mDoneCv.wait(lock, [&] {
+            return mNumThreadsSearching == 0;
+        });
     }
 
-    constexpr void blockUntilSleep()
+    // Called by each thread when it starts searching, so that threads init in parallel
+    inline void initThread(ThreadData* td)
     {
-        for (ThreadData* td : mThreadsData)
+        td->pos = mRootPos;
+        td->bothAccsStack[0] = mRootBothAccs;
+        td->bothAccsIdx = 0;
+        td->finnyTable = *mRootFinnyTable;
+
+        td->pliesData[0] = { };
+        td->pliesData[0].inCheck = td->pos.inCheck();
+        td->pliesData[0].contHists = td->histories->contHists(td->pos);
+
+        td->rootMoves = mRootMoves;
+        td->pvIdx = 0;
+        td->completedDepth = 0;
+
+        td->stats = { };
+
+        // Start latency is the latency of the last thread to start searching
+
+        const u64 latencyNs = nanosecondsElapsed(mSearchConfig.startTime);
+        u64 maxLatencyNs = mStartLatencyNs.load(std::memory_order_relaxed);
+
+        while (latencyNs > maxLatencyNs
+        && !mStartLatencyNs.compare_exchange_weak(
+            maxLatencyNs, latencyNs, std::memory_order_relaxed))
+        { }
+    }
+
+    // Called by the main thread, or by any thread that hits the nodes limit
+    inline void stopSearch()
+    {
+        if (!mStopSearch.exchange(true, std::memory_order_relaxed))
+            mStopTime = std::chrono::steady_clock::now();
+    }
+
+    // Lazy SMP: pick the thread whose best move got the most votes
+    // Each thread votes for its best move, weighted by its score and completed depth
+    constexpr const ThreadData* bestThreadData() const
+    {
+        const ThreadData* bestTd = mainThreadData();
+
+        if (mThreadsData.size() == 1 || mSearchConfig.multiPV > 1)
+            return bestTd;
+
+        i32 minScore = INF;
+
+        for (const ThreadData* td : mThreadsData)
+            if (td->completedDepth > 0)
+                minScore = std::min<i32>(minScore, td->rootMoves[0].score);
+
+        const auto votes = [&] (const Move move) constexpr -> i64
         {
-            std::unique_lock<std::mutex> lock(td->mutex);
+            i64 total = 0;
 
-            td->cv.wait(lock, [&] {
-                return td->threadState == ThreadState::Sleeping;
-            });
+            for (const ThreadData* td : mThreadsData)
+                if (td->completedDepth > 0 && bestMoveAtRoot(td) == move)
+                {
+                    const i64 scoreWeight = td->rootMoves[0].score - minScore + 14;
+                    total += scoreWeight * td->completedDepth;
+                }
+
+            return total;
+        };
+
+        for (const ThreadData* td : mThreadsData)
+        {
+            if (td->completedDepth <= 0 || !bestMoveAtRoot(td))
+                continue;
+
+            const i32 score     = td->rootMoves[0].score;
+            const i32 bestScore = bestTd->rootMoves[0].score;
+
+            // If winning, prefer the shortest mate
+            if (bestScore >= MIN_MATE_SCORE)
+            {
+                if (score > bestScore) bestTd = td;
+            }
+            else if (score >= MIN_MATE_SCORE
+            || votes(bestMoveAtRoot(td)) > votes(bestMoveAtRoot(bestTd)))
+                bestTd = td;
         }
+
+        return bestTd;
+    }
+
+    // Milliseconds elapsed as seen by the time limits
+    // In nodestime mode, nodes searched are converted to milliseconds
+    inline u64 tmMsElapsed() const
+    {
+        return mSearchConfig.nodesTime > 0
+             ? totalNodes() / mSearchConfig.nodesTime
+             : millisecondsElapsed(mSearchConfig.startTime);
     }
 
     constexpr bool isHardTimeUp(const ThreadData* td)
     {
-        // Only check time in main thread and if depth 1 completed
+        // Only check limits if this thread completed depth 1
+        if (td->rootDepth <= 1)
+            return mStopSearch.load(std::memory_order_relaxed);
+
+        const u64 threadNodes = td->nodes.load(std::memory_order_relaxed);
+
+        // Hard nodes limit, checked by every thread
+        // With 1 thread, check every node so that the limit is exact
+        // Otherwise, each thread checks the total every 1024 of its own nodes,
+        // so the limit is overshot by less than 1024 nodes per thread
+        if (mSearchConfig.maxNodes.has_value())
+        {
+            if (mThreadsData.size() == 1 && threadNodes >= *(mSearchConfig.maxNodes))
+                stopSearch();
+            else if (threadNodes % 1024 == 0 && totalNodes() >= *(mSearchConfig.maxNodes))
+                stopSearch();
+        }
+
+        // Hard time limit, only checked in main thread
         if (td == mainThreadData()
-        && td->rootDepth > 1
         && mSearchConfig.hardMs.has_value()
-        && td->nodes.load(std::memory_order_relaxed) % 1024 == 0
-        && millisecondsElapsed(mSearchConfig.startTime) >= mSearchConfig.hardMs)
-            mStopSearch.store(true, std::memory_order_relaxed);
+        && threadNodes % 1024 == 0
+        && tmMsElapsed() >= *(mSearchConfig.hardMs))
+            stopSearch();
 
         return mStopSearch.load(std::memory_order_relaxed);
     }
 
     constexpr void iterativeDeepening(ThreadData* td)
     {
+        PROFILE_SCOPE(Search);
+
         i32 score    = 0;
         i32 avgScore = 0;
 
@@ -276,59 +718,94 @@ private:
 
         for (td->rootDepth = 1; td->rootDepth <= mSearchConfig.maxDepth; td->rootDepth++)
         {
+            // In Lazy SMP, helper threads skip some depths
+            if (mSearchConfig.smpMode == SmpMode::LazySMP && td != mainThreadData())
+            {
+                const size_t i = (td->threadId - 1) % SKIP_SIZE.size();
+
+                if ((td->rootDepth + SKIP_PHASE[i]) / SKIP_SIZE[i] % 2 != 0)
+                    continue;
+            }
+
             const Move prevBestMove = bestMoveAtRoot(td);
+            const u64 iterationStartNodes = td->nodes.load(std::memory_order_relaxed);
 
-            td->maxPlyReached = 0; // Reset seldepth
+            // Root moves as of the last completed iteration, restored if this one is aborted,
+            // so that the best move, score and PV voted with match completedDepth
+            const std::vector<RootMove> completedRootMoves = td->rootMoves;
 
-            score = td->rootDepth >= 4
-                  ? aspirationWindows(td, score)
-                  : search<true, NodeType::PV>(td, td->rootDepth, 0, -INF, INF);
+            for (RootMove& rootMove : td->rootMoves)
+            {
+                rootMove.prevScore = rootMove.score;
+                rootMove.score = -INF;
+            }
 
-            if (mStopSearch.load(std::memory_order_relaxed))
-                break;
+            bool aborted = false;
 
-            // Only print uci info and check limits in main thread
-            if (td != mainThreadData())
-                continue;
+            // Search every PV line (MultiPV)
+            // Each line excludes the best moves of the previous lines
+            for (td->pvIdx = 0; td->pvIdx < mSearchConfig.multiPV; td->pvIdx++)
+            {
+                td->maxPlyReached = 0; // Reset seldepth
 
-            // Print uci info
+                if (td->rootDepth >= 4 && td->completedDepth > 0)
+                    aspirationWindows(td, td->rootMoves[td->pvIdx].prevScore);
+                else
+                    search<true, NodeType::PV>(td, td->rootDepth, 0, -INF, INF);
 
-            const u64 msElapsed = millisecondsElapsed(mSearchConfig.startTime);
-            const u64 nodes = totalNodes();
+                aborted = mStopSearch.load(std::memory_order_relaxed);
 
-            if (!mSearchConfig.printInfo)
-                goto checkLimits;
+                // The scores of an aborted iteration are only used if no iteration completed
+                if (aborted && td->completedDepth > 0)
+                    break;
 
-            std::cout << "info"
-                      << " depth "    << td->rootDepth
-                      << " seldepth " << td->maxPlyReached
-                      << " score ";
+                const auto sortRootMoves = [td] (const size_t start, const size_t end) constexpr
+                {
+                    std::stable_sort(
+                        td->rootMoves.begin() + static_cast<std::ptrdiff_t>(start),
+                        td->rootMoves.begin() + static_cast<std::ptrdiff_t>(end),
+                        [] (const RootMove& a, const RootMove& b) { return a.score > b.score; }
+                    );
+                };
 
-            if (std::abs(score) < MIN_MATE_SCORE)
-                std::cout << "cp " << score;
-            else {
-                const i32 pliesToMate = INF - std::abs(score);
-                const i32 fullMovesToMate = (pliesToMate + 1) / 2;
-                std::cout << "mate " << (score > 0 ? fullMovesToMate : -fullMovesToMate);
+                // Bring this line's best move to the front of the remaining moves,
+                // then sort the PV lines searched so far
+                sortRootMoves(td->pvIdx, td->rootMoves.size());
+                sortRootMoves(0, td->pvIdx + 1);
+
+                if (aborted) break;
             }
 
-            std::cout << " nodes " << nodes
-                      << " nps "   << getNps(nodes, msElapsed)
-                      << " time "  << msElapsed
-                      << " pv";
+            if (aborted)
+            {
+                if (td->completedDepth > 0)
+                    td->rootMoves = completedRootMoves;
 
-            for (const Move move : td->pliesData[0].pvLine)
-                std::cout << " " << move.toUci();
+                break;
+            }
 
-            std::cout << std::endl;
+            td->completedDepth = td->rootDepth;
+            score = td->rootMoves[0].score;
 
-            checkLimits:
+            if constexpr (STATS_ENABLED)
+                td->stats.depthNodes[static_cast<size_t>(td->rootDepth)]
+                    = td->nodes.load(std::memory_order_relaxed) - iterationStartNodes;
+
+            // Only print uci info and check limits in main thread
+            if (td != mainThreadData())
+                continue;
+
+            const u64 nodes = totalNodes();
+            const u64 limitsMsElapsed = tmMsElapsed();
+
+            if (mSearchConfig.printInfo)
+                printUciInfo(td);
 
             // Hard time limit hit?
-            if (mSearchConfig.hardMs.has_value() && msElapsed >= mSearchConfig.hardMs)
+            if (mSearchConfig.hardMs.has_value() && limitsMsElapsed >= mSearchConfig.hardMs)
                 break;
 
-            // Soft nodes limit hit?
+            // Nodes limit hit?
             if (mSearchConfig.maxNodes.has_value() && nodes >= mSearchConfig.maxNodes)
                 break;
 
@@ -358,7 +835,7 @@ private:
                 // Less/more soft time the bigger/smaller the fraction of nodes spent on best move
 
                 const u64 threadNodes   = td->nodes.load(std::memory_order_relaxed);
-                const u64 bestMoveNodes = td->nodesByMove[bestMoveAtRoot(td).asU16()];
+                const u64 bestMoveNodes = td->rootMoves[0].nodes;
 
                 const double bestMoveNodesFraction
                     = static_cast<double>(bestMoveNodes)
@@ -386,13 +863,51 @@ private:
                 return static_cast<u64>(originalSoftMs * scale);
             };
 
-            if (msElapsed >= (td->rootDepth >= 6 ? softMsScaled() : mSearchConfig.softMs))
+            if (limitsMsElapsed >= (td->rootDepth >= 6 ? softMsScaled() : mSearchConfig.softMs))
                 break;
         }
 
         // If main thread, signal other threads to stop searching
         if (td == mainThreadData())
-            mStopSearch.store(true, std::memory_order_relaxed);
+            stopSearch();
+    }
+
+    inline void printUciInfo(const ThreadData* td) const
+    {
+        const u64 msElapsed = millisecondsElapsed(mSearchConfig.startTime);
+        const u64 nodes = totalNodes();
+
+        for (size_t i = 0; i < mSearchConfig.multiPV; i++)
+        {
+            const RootMove& rootMove = td->rootMoves[i];
+
+            std::cout << "info"
+                      << " depth "    << td->rootDepth
+                      << " seldepth " << rootMove.selDepth;
+
+            if (mSearchConfig.multiPV > 1)
+                std::cout << " multipv " << i + 1;
+
+            std::cout << " score ";
+
+            if (std::abs(rootMove.score) < MIN_MATE_SCORE)
+                std::cout << "cp " << rootMove.score;
+            else {
+                const i32 pliesToMate = INF - std::abs(rootMove.score);
+                const i32 fullMovesToMate = (pliesToMate + 1) / 2;
+                std::cout << "mate " << (rootMove.score > 0 ? fullMovesToMate : -fullMovesToMate);
+            }
+
+            std::cout << " nodes " << nodes
+                      << " nps "   << getNps(nodes, msElapsed)
+                      << " time "  << msElapsed
+                      << " pv";
+
+            for (const Move move : rootMove.pvLine)
+                std::cout << " " << move.toUci();
+
+            std::cout << std::endl;
+        }
     }
 
     constexpr i32 aspirationWindows(ThreadData* td, i32 score)
@@ -466,18 +981,16 @@ private:
         // Quiescence search at leaf nodes
         if (depth <= 0) return qSearch<nodeType == NodeType::PV>(td, ply, alpha, beta);
 
+        td->stats.inc(Stat::SearchNodes);
+
         if (isHardTimeUp(td)) return 0;
 
+        // Checkmate and stalemate are detected after the moves loop
         if constexpr (!isRoot)
         {
-            const GameState gameState = td->pos.gameState(hasLegalMove, ply);
-
-            if (gameState == GameState::Draw)
+            if (td->pos.isDraw(hasLegalMove, ply))
                 return 0;
 
-            if (gameState == GameState::Loss)
-                return -INF + static_cast<i32>(ply);
-
             // Detect upcoming repetition (cuckoo)
             if (alpha < 0 && td->pos.hasUpcomingRepetition(ply) && (alpha = 0) >= beta)
                 return 0;
@@ -492,6 +1005,9 @@ private:
         const auto [ttDepth, ttScore, ttBound, ttMove]
             = ttEntry.get(td->pos.zobristHash(), static_cast<i16>(ply));
 
+        if (ttBound != Bound::None)
+            td->stats.inc(Stat::TTHits);
+
         // TT cutoff
         if (nodeType != NodeType::PV
         && !singularMove
@@ -499,7 +1015,10 @@ private:
         && (ttBound == Bound::Exact
         || (ttBound == Bound::Upper && ttScore <= alpha)
         || (ttBound == Bound::Lower && ttScore >= beta)))
+        {
+            td->stats.inc(Stat::TTCutoffs);
             return *ttScore;
+        }
 
         PlyData& plyData = td->pliesData[ply];
         const i32 eval = getEval(td, plyData);
@@ -521,12 +1040,18 @@ private:
             if (depth <= 7
             && std::abs(beta) < MIN_MATE_SCORE
             && eval - beta >= std::max<i32>(depth - oppWorsening, 1) * rfpDepthMul())
+            {
+                td->stats.inc(Stat::RfpCutoffs);
                 return (eval + beta) / 2;
+            }
 
             // Razoring
             if (std::abs(alpha) < MIN_MATE_SCORE
             && alpha - eval > razoringBase() + depth * depth * razoringDepthMul())
+            {
+                td->stats.inc(Stat::Razorings);
                 return qSearch<nodeType == NodeType::PV>(td, ply, alpha, beta);
+            }
 
             // NMP (Null move pruning)
             if (td->pos.lastMove()
@@ -536,6 +1061,8 @@ private:
             && eval >= beta
             && (ttBound != Bound::Upper || ttScore >= beta))
             {
+                td->stats.inc(Stat::NmpAttempts);
+
                 makeMove(td, MOVE_NONE, ply + 1, mTT);
 
                 const i32 nmpDepth = depth - 4 - depth / 3;
@@ -546,7 +1073,11 @@ private:
 
                 undoMove(td);
 
-                if (score >= beta) return score >= MIN_MATE_SCORE ? beta : score;
+                if (score >= beta)
+                {
+                    td->stats.inc(Stat::NmpCutoffs);
+                    return score >= MIN_MATE_SCORE ? beta : score;
+                }
             }
 
             // Probcut
@@ -557,11 +1088,17 @@ private:
             && std::abs(beta) < MIN_MATE_SCORE
             && (ttBound == Bound::None || depth - *ttDepth >= 4 || ttScore >= probcutBeta))
             {
+                td->stats.inc(Stat::ProbcutAttempts);
+
                 const std::optional<i32> score = probcut<nodeType == NodeType::Cut>(
                     td, depth, ply, probcutBeta, ttMove, ttEntry
                 );
 
-                if (score.has_value()) return *score;
+                if (score.has_value())
+                {
+                    td->stats.inc(Stat::ProbcutCutoffs);
+                    return *score;
+                }
             }
         }
 
@@ -578,18 +1115,68 @@ private:
         plyData.failLowNoisies.clear();
         plyData.failLowQuiets .clear();
 
+        // ABDADA: moves being searched by other threads are deferred
+        // and searched after the move picker is done
+        // The deferred moves are held in PlyData to keep them off the stack
+        // A singular search at this ply clears them, but it only searches the TT move,
+        // the first move, before any move is deferred
+        const bool abdada = mAbdada && depth >= ABDADA_MIN_DEPTH && !singularMove;
+        ArrayVec<ScoredMove, 256>& deferredMoves = plyData.deferredMoves;
+        deferredMoves.clear();
+        size_t deferredIdx = 0;
+        bool mpDone = false;
+
         // Moves loop
         MovePicker mp = MovePicker(false, ttMove, plyData.killer, singularMove);
         while (true)
         {
-            // Move, i32
-            const auto [move, moveScore] = mp.nextLegal(td->pos, td->historyTable);
+            ScoredMove scoredMove = { .move = MOVE_NONE, .score = 0 };
+
+            if (!mpDone)
+            {
+                scoredMove = mp.nextLegal(
+                    td->pos, td->histories->historyTable, plyData.contHists
+                );
+                mpDone = !scoredMove.move;
+            }
+
+            if (mpDone && deferredIdx < deferredMoves.size())
+                scoredMove = deferredMoves[deferredIdx++];
+
+            const auto [move, moveScore] = scoredMove;
 
             if (!move) break;
 
             // In singular searches, singular move (TT move) isn't searched
             assert(move != singularMove);
 
+            RootMove* rootMove = nullptr;
+
+            // At root, skip best moves of previous PV lines (MultiPV)
+            // and moves not in "go searchmoves"
+            if constexpr (isRoot)
+            {
+                const auto it = std::find_if(
+                    td->rootMoves.begin() + static_cast<std::ptrdiff_t>(td->pvIdx),
+                    td->rootMoves.end(),
+                    [move] (const RootMove& rm) { return rm.move == move; }
+                );
+
+                if (it == td->rootMoves.end()) continue;
+
+                rootMove = &(*it);
+            }
+
+            const u64 abdadaKey = abdada ? AbdadaTable::moveKey(td->pos.zobristHash(), move) : 0;
+
+            // ABDADA: defer move if another thread is searching it
+            // The first move is always searched
+            if (abdada && !mpDone && legalMovesSeen > 0 && mAbdadaTable.isBusy(abdadaKey))
+            {
+                deferredMoves.push_back(scoredMove);
+                continue;
+            }
+
             legalMovesSeen++;
 
             const bool isQuiet = td->pos.isQuiet(move);
@@ -605,8 +1192,12 @@ private:
             if (!isRoot && bestScore > -MIN_MATE_SCORE && (isQuiet || moveScore < 0))
             {
                 // LMP (Late move pruning)
+                // Stop picking moves, but still search deferred moves (ABDADA)
                 if (legalMovesSeen > static_cast<size_t>(2 + depth * depth))
-                    break;
+                {
+                    mpDone = true;
+                    continue;
+                }
 
                 // FP (Futility pruning)
 
@@ -624,7 +1215,10 @@ private:
                 && legalMovesSeen > 2
                 && std::abs(alpha) < MIN_MATE_SCORE
                 && alpha - eval > fpMargin())
-                    break;
+                {
+                    mpDone = true;
+                    continue;
+                }
 
                 // SEE pruning
 
@@ -652,6 +1246,8 @@ private:
                 constexpr NodeType newNodeType
                     = nodeType == NodeType::Cut ? NodeType::Cut : NodeType::All;
 
+                td->stats.inc(Stat::SeSearches);
+
                 const i32 seBeta = std::max<i32>(*ttScore - depth, -MIN_MATE_SCORE);
 
                 const i32 seScore = search<isRoot, newNodeType>(
@@ -661,18 +1257,31 @@ private:
                 // Single or double extension
                 if (seScore < seBeta)
                 {
-                    newDepth++;
-                    newDepth += seScore > -MIN_MATE_SCORE && seBeta - seScore > doubleExtMargin();
+                    const bool doubleExt
+                        = seScore > -MIN_MATE_SCORE && seBeta - seScore > doubleExtMargin();
+
+                    newDepth += 1 + doubleExt;
+
+                    td->stats.inc(doubleExt ? Stat::SeDoubleExts : Stat::SeSingleExts);
                 }
                 // Multicut
                 else if (seScore >= beta && std::abs(seScore) < MIN_MATE_SCORE)
+                {
+                    td->stats.inc(Stat::SeMulticuts);
                     return seScore;
+                }
                 // Negative extension
                 else if (ttScore >= beta)
+                {
                     newDepth -= 3;
+                    td->stats.inc(Stat::SeNegativeExts);
+                }
                 // Expected cut-node negative extension
                 else if constexpr (nodeType == NodeType::Cut)
+                {
                     newDepth -= 2;
+                    td->stats.inc(Stat::SeNegativeExts);
+                }
 
                 // The singular search used these so clear them
                 plyData.failLowNoisies.clear();
@@ -681,6 +1290,8 @@ private:
 
             const u64 nodesBefore = td->nodes.load(std::memory_order_relaxed);
 
+            if (abdada) mAbdadaTable.setBusy(abdadaKey);
+
             makeMove(td, move, ply + 1, mTT);
 
             const std::optional<PieceType> captured = td->pos.captured();
@@ -716,6 +1327,8 @@ private:
                 // Don't reduce into quiescence search nor extend
                 reducedDepth = std::clamp<i32>(reducedDepth, 1, newDepth);
 
+                td->stats.inc(Stat::LmrSearches);
+
                 // Reduced depth, zero window search
                 score = -search<false, NodeType::Cut>(
                     td, reducedDepth, ply + 1, -alpha - 1, -alpha
@@ -735,6 +1348,8 @@ private:
                     doFullDepthZws = reducedDepth < newDepth;
                 }
 
+                if (doFullDepthZws) td->stats.inc(Stat::LmrResearches);
+
                 numFailHighs += score > alpha;
             }
 
@@ -758,6 +1373,8 @@ private:
 
             undoMove(td);
 
+            if (abdada) mAbdadaTable.resetBusy(abdadaKey);
+
             if (mStopSearch.load(std::memory_order_relaxed))
                 return 0;
 
@@ -765,8 +1382,23 @@ private:
 
             if constexpr (isRoot)
             {
-                td->nodesByMove[move.asU16()]
-                    += td->nodes.load(std::memory_order_relaxed) - nodesBefore;
+                rootMove->nodes += td->nodes.load(std::memory_order_relaxed) - nodesBefore;
+
+                // Best move of this PV line so far?
+                if (legalMovesSeen == 1 || score > alpha)
+                {
+                    rootMove->score = score;
+                    rootMove->selDepth = td->maxPlyReached;
+
+                    rootMove->pvLine.clear();
+                    rootMove->pvLine.push_back(move);
+
+                    // Copy child's PV line
+                    for (const Move m : td->pliesData[1].pvLine)
+                        rootMove->pvLine.push_back(m);
+                }
+                else
+                    rootMove->score = -INF;
             }
 
             bestScore = std::max<i32>(bestScore, score);
@@ -802,10 +1434,16 @@ private:
             {
                 bound = Bound::Lower;
 
+                td->stats.inc(Stat::FailHighs);
+
+                if (legalMovesSeen == 1)
+                    td->stats.inc(Stat::FirstMoveFailHighs);
+
                 if (isQuiet) plyData.killer = move;
 
                 updateHistories(
                     td,
+                    plyData.contHists,
                     move,
                     captured,
                     depth,
@@ -820,13 +1458,17 @@ private:
 
         if (legalMovesSeen == 0)
         {
-            assert(singularMove);
-            return alpha;
+            if (singularMove)
+                return alpha;
+
+            // Checkmate or stalemate
+            return td->pos.inCheck() ? -INF + static_cast<i32>(ply) : 0;
         }
 
         assert(std::abs(bestScore) < INF);
 
-        if (!singularMove)
+        // In MultiPV, only the first PV line's root results are stored
+        if (!singularMove && (!isRoot || td->pvIdx == 0))
         {
             // Update TT entry
             ttEntry.update(
@@ -865,16 +1507,15 @@ private:
         assert(alpha < beta);
         assert(pvNode || alpha + 1 == beta);
 
-        if (isHardTimeUp(td)) return 0;
+        td->stats.inc(Stat::QsNodes);
 
-        const GameState gameState = td->pos.gameState(hasLegalMove, ply);
+        if (isHardTimeUp(td)) return 0;
 
-        if (gameState == GameState::Draw)
+        // If in check, checkmate is detected after the moves loop, which then has all moves
+        // Stalemate isn't detected, since only noisy moves are searched if not in check
+        if (td->pos.isDraw(hasLegalMove, ply))
             return 0;
 
-        if (gameState == GameState::Loss)
-            return -INF + static_cast<i32>(ply);
-
         // Detect upcoming repetition (cuckoo)
         if (alpha < 0 && td->pos.hasUpcomingRepetition(ply) && (alpha = 0) >= beta)
             return 0;
@@ -927,7 +1568,9 @@ private:
         while (true)
         {
             // Move, i32
-            const auto [move, moveScore] = mp.nextLegal(td->pos, td->historyTable);
+            const auto [move, moveScore] = mp.nextLegal(
+                td->pos, td->histories->historyTable, plyData.contHists
+            );
 
             if (!move) break;
 
@@ -986,13 +1629,27 @@ private:
                 bound = Bound::Lower;
 
                 updateHistories(
-                    td, move, captured, 1, 1, plyData.failLowNoisies, plyData.failLowQuiets
+                    td,
+                    plyData.contHists,
+                    move,
+                    captured,
+                    1,
+                    1,
+                    plyData.failLowNoisies,
+                    plyData.failLowQuiets
                 );
 
                 break;
             }
         }
 
+        // Checkmate
+        if (bestScore == -INF)
+        {
+            assert(td->pos.inCheck() && !hasLegalMove(td->pos));
+            return -INF + static_cast<i32>(ply);
+        }
+
         assert(std::abs(bestScore) < INF);
 
         // Update TT entry
@@ -1029,7 +1686,9 @@ private:
         while (true)
         {
             // Move, i32
-            const auto [move, moveScore] = mp.nextLegal(td->pos, td->historyTable);
+            const auto [move, moveScore] = mp.nextLegal(
+                td->pos, td->histories->historyTable, td->pliesData[ply].contHists
+            );
 
             // Prune underpromotions
             if (!move || move.isUnderpromotion())
@@ -0,0 +1,194 @@
+// clang-format off
+
+#pragma once
+
+#include "utils.hpp"
+#include "search_params.hpp"
+#include <optional>
+#include <iomanip>
+
+// Search statistics
+// Only counted if compiled with -DSTATS (make stats), otherwise every update compiles to nothing
+
+#if defined(STATS)
+    constexpr bool STATS_ENABLED = true;
+#else
+    constexpr bool STATS_ENABLED = false;
+#endif
+
+enum class Stat : i32 {
+    SearchNodes, QsNodes,
+    TTHits, TTCutoffs,
+    RfpCutoffs,
+    Razorings,
+    NmpAttempts, NmpCutoffs,
+    ProbcutAttempts, ProbcutCutoffs,
+    LmrSearches, LmrResearches,
+    SeSearches, SeSingleExts, SeDoubleExts, SeMulticuts, SeNegativeExts,
+    FailHighs, FirstMoveFailHighs,
+    Count
+};
+
+inline std::string statName(const Stat stat)
+{
+    switch (stat) {
+        case Stat::SearchNodes:        return "search nodes";
+        case Stat::QsNodes:            return "qsearch nodes";
+        case Stat::TTHits:             return "tt hits";
+        case Stat::TTCutoffs:          return "tt cutoffs";
+        case Stat::RfpCutoffs:         return "rfp cutoffs";
+        case Stat::Razorings:          return "razorings";
+        case Stat::NmpAttempts:        return "nmp attempts";
+        case Stat::NmpCutoffs:         return "nmp cutoffs";
+        case Stat::ProbcutAttempts:    return "probcut attempts";
+        case Stat::ProbcutCutoffs:     return "probcut cutoffs";
+        case Stat::LmrSearches:        return "lmr searches";
+        case Stat::LmrResearches:      return "lmr re-searches";
+        case Stat::SeSearches:         return "se searches";
+        case Stat::SeSingleExts:       return "se single extensions";
+        case Stat::SeDoubleExts:       return "se double extensions";
+        case Stat::SeMulticuts:        return "se multicuts";
+        case Stat::SeNegativeExts:     return "se negative extensions";
+        case Stat::FailHighs:          return "fail highs";
+        case Stat::FirstMoveFailHighs: return "first move fail highs";
+        default:                       return "";
+    }
+}
+
+struct SearchStats
+{
+public:
+
+    EnumArray<u64, Stat> counters = { };
+
+    // Nodes searched in each iterative deepening iteration
+    std::array<u64, MAX_DEPTH + 1> depthNodes = { }; // [depth]
+
+    constexpr void inc(const Stat stat)
+    {
+        if constexpr (STATS_ENABLED)
+            counters[stat]++;
+    }
+
+    constexpr void add(const SearchStats& other)
+    {
+        for (const Stat stat : EnumIter<Stat>())
+            counters[stat] += other.counters[stat];
+
+        for (size_t depth = 0; depth < depthNodes.size(); depth++)
+            depthNodes[depth] += other.depthNodes[depth];
+    }
+
+    inline void print() const
+    {
+        if constexpr (!STATS_ENABLED)
+        {
+            std::cout << "info string Search stats disabled, compile with -DSTATS (make stats)"
+                      << std::endl;
+
+            return;
+        }
+
+        const std::ios_base::fmtflags oldFlags = std::cout.flags();
+        const std::streamsize oldPrecision = std::cout.precision();
+
+        std::cout << std::fixed << std::setprecision(2);
+
+        // Prints counter and its percentage of another counter
+        const auto printStat = [&] (const Stat stat, const std::optional<Stat> total) constexpr
+        {
+            std::cout << std::left << std::setw(26) << statName(stat) << std::right
+                      << std::setw(14) << counters[stat];
+
+            if (total.has_value())
+            {
+                const u64 totalCount = std::max<u64>(counters[*total], 1);
+
+                std::cout << "  " << std::setw(6)
+                          << static_cast<double>(counters[stat]) * 100.0
+                             / static_cast<double>(totalCount)
+                          << "%";
+            }
+
+            std::cout << std::endl;
+        };
+
+        const u64 nodes = counters[Stat::SearchNodes] + counters[Stat::QsNodes];
+
+        std::cout << std::left << std::setw(26) << "nodes" << std::right
+                  << std::setw(14) << nodes << std::endl;
+
+        printStat(Stat::SearchNodes, std::nullopt);
+        printStat(Stat::QsNodes, std::nullopt);
+
+        std::cout << std::left << std::setw(26) << "qsearch node share" << std::right
+                  << std::setw(14) << "" << "  " << std::setw(6)
+                  << static_cast<double>(counters[Stat::QsNodes]) * 100.0
+                     / static_cast<double>(std::max<u64>(nodes, 1))
+                  << "%" << std::endl;
+
+        printStat(Stat::TTHits, Stat::SearchNodes);
+        printStat(Stat::TTCutoffs, Stat::TTHits);
+        printStat(Stat::RfpCutoffs, Stat::SearchNodes);
+        printStat(Stat::Razorings, Stat::SearchNodes);
+        printStat(Stat::NmpAttempts, Stat::SearchNodes);
+        printStat(Stat::NmpCutoffs, Stat::NmpAttempts);
+        printStat(Stat::ProbcutAttempts, Stat::SearchNodes);
+        printStat(Stat::ProbcutCutoffs, Stat::ProbcutAttempts);
+        printStat(Stat::LmrSearches, std::nullopt);
+        printStat(Stat::LmrResearches, Stat::LmrSearches);
+        printStat(Stat::SeSearches, std::nullopt);
+        printStat(Stat::SeSingleExts, Stat::SeSearches);
+        printStat(Stat::SeDoubleExts, Stat::SeSearches);
+        printStat(Stat::SeMulticuts, Stat::SeSearches);
+        printStat(Stat::SeNegativeExts, Stat::SeSearches);
+        printStat(Stat::FailHighs, std::nullopt);
+        printStat(Stat::FirstMoveFailHighs, Stat::FailHighs);
+
+        // Effective branching factor: nodes of an iteration / nodes of the previous iteration
+        for (size_t depth = 1; depth < depthNodes.size(); depth++)
+        {
+            if (depthNodes[depth] == 0) continue;
+
+            std::cout << "depth " << std::setw(3) << depth
+                      << " nodes " << std::setw(12) << depthNodes[depth];
+
+            if (depthNodes[depth - 1] > 0)
+                std::cout << " ebf "
+                          << static_cast<double>(depthNodes[depth])
+                             / static_cast<double>(depthNodes[depth - 1]);
+
+            std::cout << std::endl;
+        }
+
+        std::cout.flags(oldFlags);
+        std::cout.precision(oldPrecision);
+    }
+
+    // Counters and nodes of each iterative deepening iteration, as a JSON object without a newline
+    inline void printJson() const
+    {
+        std::cout << "{";
+
+        for (const Stat stat : EnumIter<Stat>())
+            std::cout << (stat != Stat::SearchNodes ? "," : "")
+                      << "\"" << statName(stat) << "\":" << counters[stat];
+
+        std::cout << ",\"depth nodes\":[";
+
+        bool first = true;
+
+        for (size_t depth = 1; depth < depthNodes.size(); depth++)
+        {
+            if (depthNodes[depth] == 0) continue;
+
+            std::cout << (first ? "" : ",")
+                      << "{\"depth\":" << depth << ",\"nodes\":" << depthNodes[depth] << "}";
+
+            first = false;
+        }
+
+        std::cout << "]}";
+    }
+
+}; // struct SearchStats
@@ -0,0 +1,112 @@
+// clang-format off
+
+#pragma once
+
+#include "utils.hpp"
+#include <fstream>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Appends records (lines) to a file in a background thread
+// push() only queues the record, so callers never wait for file I/O
+class TelemetryWriter
+{
+private:
+
+    std::string mFilePath = ""; // Empty if disabled
+
+    std::thread mThread;
+    std::mutex mMutex;
+    std::condition_variable mCv;
+
+    std::deque<std::string> mQueue = { }; // Guarded by mMutex
+    bool mExit = false; // Guarded by mMutex
+
+    inline void loop()
+    {
+        std::ofstream file(mFilePath, std::ios::app);
+
+        std::unique_lock<std::mutex> lock(mMutex);
+
+        while (true)
+        {
+            mCv.wait(lock, [&] { return mExit || !mQueue.empty(); });
+
+            // Write all queued records before exiting
+            while (!mQueue.empty())
+            {
+                const std::string record = std::move(mQueue.front());
+                mQueue.pop_front();
+
+                lock.unlock();
+
+                if (file.is_open())
+                    file << record << std::endl;
+
+                lock.lock();
+            }
+
+            if (mExit) return;
+        }
+    }
+
+    inline void stop()
+    {
+        if (!mThread.joinable()) return;
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mExit = true;
+        }
+
+        mCv.notify_one();
+        mThread.join();
+        mExit = false;
+    }
+
+public:
+
+    inline ~TelemetryWriter() {
+        stop();
+    }
+
+    constexpr bool enabled() const {
+        return mFilePath != "";
+    }
+
+    // Empty file path disables telemetry
+    inline void setFile(const std::string& filePath)
+    {
+        stop();
+
+        mFilePath = filePath;
+
+        if (enabled())
+            mThread = std::thread([this] () { loop(); });
+    }
+
+    // Writes every queued record before returning
+    // Call before exiting without destroying this writer, e.g. on "quit"
+    inline void flush()
+    {
+        stop();
+
+        if (enabled())
+            mThread = std::thread([this] () { loop(); });
+    }
+
+    inline void push(std::string record)
+    {
+        if (!enabled()) return;
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mQueue.push_back(std::move(record));
+        }
+
+        mCv.notify_one();
+    }
+
+}; // class TelemetryWriter
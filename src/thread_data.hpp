@@ -9,10 +9,10 @@
 #include "nnue.hpp"
 #include "tt.hpp"
 #include "history_entry.hpp"
+#include "move_picker.hpp"
+#include "stats.hpp"
 #include <algorithm>
 #include <atomic>
-#include <mutex>
-#include <condition_variable>
 
 struct PlyData
 {
@@ -28,11 +28,32 @@ public:
     ArrayVec<Move, 256> failLowQuiets;
     ArrayVec<std::pair<Move, std::optional<PieceType>>, 256> failLowNoisies; // move, captured
 
+    // ABDADA: moves being searched by other threads, searched after the move picker is done
+    ArrayVec<ScoredMove, 256> deferredMoves;
+
+    ContHists contHists = { }; // Of the 2 moves that led to this ply
+
 }; // struct PlyData
 
-enum class ThreadState : i32 {
-    Sleeping, Searching, ExitAsap, Exited
-};
+struct RootMove
+{
+public:
+
+    Move move = MOVE_NONE;
+
+    // Score of this move in the current and previous iterations
+    // -INF if this move wasn't the best move of its PV line
+    i32 score     = -INF;
+    i32 prevScore = -INF;
+
+    ArrayVec<Move, MAX_DEPTH + 1> pvLine;
+
+    u64 nodes = 0; // Nodes spent on this move in this search
+    size_t selDepth = 0;
+
+    inline RootMove(const Move rootMove) : move(rootMove) { }
+
+}; // struct RootMove
 
 struct ThreadData
 {
@@ -40,53 +61,55 @@ public:
 
     Position pos;
 
+    size_t threadId = 0; // Main thread is 0
+
     i32 rootDepth = 0;
+    i32 completedDepth = 0; // Last depth fully searched
 
     std::atomic<u64> nodes = 0;
     size_t maxPlyReached = 0;
 
     std::array<PlyData, MAX_DEPTH + 1> pliesData; // [ply]
 
-    std::array<u64, 1ULL << 17> nodesByMove; // [Move.asU16()]
+    // Root moves to search, sorted by score after every root search
+    // For MultiPV, rootMoves[pvIdx] is the PV line being searched
+    std::vector<RootMove> rootMoves = { };
+    size_t pvIdx = 0;
 
-    HistoryTable historyTable = { };
+    Histories* histories = nullptr; // Owned by Searcher, may be shared with other threads
 
     std::array<nnue::BothAccumulators, MAX_DEPTH + 1> bothAccsStack;
     size_t bothAccsIdx = 0;
 
     nnue::FinnyTable finnyTable;
 
-    // [stm][pawnsHash % CORR_HIST_SIZE]
-    EnumArray<std::array<i16, CORR_HIST_SIZE>, Color> pawnsCorrHist = { };
+    const nnue::Net* net = nnue::NET; // NET or a copy of it in this thread's NUMA node
 
-    // [stm][pieceColor][[pieceColorNonPawnsHash % CORR_HIST_SIZE]
-    EnumArray<std::array<i16, CORR_HIST_SIZE>, Color, Color> nonPawnsCorrHist = { };
+    SearchStats stats; // Only counted with -DSTATS
 
-    // Threading stuff
-    ThreadState threadState = ThreadState::Sleeping;
-    std::mutex mutex;
-    std::condition_variable cv;
+    bool exitAsap = false; // Guarded by the thread pool's mutex
 
 }; // struct ThreadData
 
-inline void wakeThread(ThreadData* td, const ThreadState newState)
-{
-    std::unique_lock<std::mutex> lock(td->mutex);
-    td->threadState = newState;
-    lock.unlock();
-    td->cv.notify_one();
-}
-
 constexpr Move bestMoveAtRoot(const ThreadData* td)
 {
-    return td->pliesData[0].pvLine.size() > 0
-         ? td->pliesData[0].pvLine[0]
+    return td->rootMoves.size() > 0 && td->rootMoves[0].pvLine.size() > 0
+         ? td->rootMoves[0].move
          : MOVE_NONE;
 }
 
 inline void makeMove(
     ThreadData* td, const Move move, const size_t newPly, std::vector<TTEntry>& tt)
 {
+    assert(newPly > 0);
+
+    PlyData& newPlyData = td->pliesData[newPly];
+
+    newPlyData.contHists = {
+        td->histories->contHist(td->pos.sideToMove(), move),
+        td->pliesData[newPly - 1].contHists[0]
+    };
+
     td->pos.makeMove(move);
 
     // Prefetch TT entry
@@ -98,7 +121,6 @@ inline void makeMove(
     // Update seldepth
     td->maxPlyReached = std::max<size_t>(td->maxPlyReached, newPly);
 
-    PlyData& newPlyData = td->pliesData[newPly];
     newPlyData.inCheck = td->pos.inCheck();
     newPlyData.pvLine.clear();
     newPlyData.rawEval = newPlyData.correctedEval = std::nullopt;
@@ -124,13 +146,17 @@ constexpr void updateBothAccs(ThreadData* td)
 
     if (td->bothAccsIdx > 0)
     {
+        PROFILE_SCOPE(AccUpdate);
+
         td->bothAccsStack[td->bothAccsIdx]
-            .updateMove(td->bothAccsStack[td->bothAccsIdx - 1], td->pos, td->finnyTable);
+            .updateMove(td->bothAccsStack[td->bothAccsIdx - 1], td->pos, td->finnyTable, td->net);
     }
 }
 
 constexpr auto corrHistsPtrs(ThreadData* td)
 {
+    Histories& histories = *(td->histories);
+
     const size_t whiteNonPawnsIdx = td->pos.nonPawnsHash(Color::White) % CORR_HIST_SIZE;
     const size_t blackNonPawnsIdx = td->pos.nonPawnsHash(Color::Black) % CORR_HIST_SIZE;
 
@@ -141,7 +167,7 @@ constexpr auto corrHistsPtrs(ThreadData* td)
     if (prevMove)
     {
         HistoryEntry& histEntry
-            = td->historyTable[td->pos.sideToMove()][prevMove.pieceType()][prevMove.to()];
+            = histories.historyTable[td->pos.sideToMove()][prevMove.pieceType()][prevMove.to()];
 
         lastMoveCorrPtr = &(histEntry.mCorrHist);
 
@@ -152,9 +178,9 @@ constexpr auto corrHistsPtrs(ThreadData* td)
     }
 
     return std::array {
-        &(td->pawnsCorrHist[td->pos.sideToMove()][td->pos.pawnsHash() % CORR_HIST_SIZE]),
-        &(td->nonPawnsCorrHist[td->pos.sideToMove()][Color::White][whiteNonPawnsIdx]),
-        &(td->nonPawnsCorrHist[td->pos.sideToMove()][Color::Black][blackNonPawnsIdx]),
+        &(histories.pawnsCorrHist[td->pos.sideToMove()][td->pos.pawnsHash() % CORR_HIST_SIZE]),
+        &(histories.nonPawnsCorrHist[td->pos.sideToMove()][Color::White][whiteNonPawnsIdx]),
+        &(histories.nonPawnsCorrHist[td->pos.sideToMove()][Color::Black][blackNonPawnsIdx]),
         lastMoveCorrPtr,
         contCorrPtr
     };
@@ -171,7 +197,9 @@ constexpr i32 getEval(ThreadData* td, PlyData& plyData)
     if (!plyData.rawEval.has_value())
     {
         updateBothAccs(td);
-        plyData.rawEval = nnue::evaluate(td->bothAccsStack[td->bothAccsIdx], td->pos.sideToMove());
+        plyData.rawEval = nnue::evaluate(
+            td->bothAccsStack[td->bothAccsIdx], td->pos.sideToMove(), td->net
+        );
 
         // Scale eval with halfmove clock
         const i32 pliesSincePawnOrCapture = static_cast<i32>(td->pos.pliesSincePawnOrCapture());
@@ -186,17 +214,17 @@ constexpr i32 getEval(ThreadData* td, PlyData& plyData)
         pawnsCorrPtr, whiteNonPawnsCorrPtr, blackNonPawnsCorrPtr, lastMoveCorrPtr, contCorrPtr
     ] = corrHistsPtrs(td);
 
-    const i32 nonPawnsCorr
-        = static_cast<i32>(*whiteNonPawnsCorrPtr) + static_cast<i32>(*blackNonPawnsCorrPtr);
+    const i32 nonPawnsCorr = static_cast<i32>(loadHistory(*whiteNonPawnsCorrPtr))
+                           + static_cast<i32>(loadHistory(*blackNonPawnsCorrPtr));
 
-    float correction = static_cast<float>(*pawnsCorrPtr) * corrHistPawnsWeight()
-                     + static_cast<float>(nonPawnsCorr)  * corrHistNonPawnsWeight();
+    float correction = static_cast<float>(loadHistory(*pawnsCorrPtr)) * corrHistPawnsWeight()
+                     + static_cast<float>(nonPawnsCorr) * corrHistNonPawnsWeight();
 
     if (lastMoveCorrPtr != nullptr)
-        correction += static_cast<float>(*lastMoveCorrPtr) * corrHistLastMoveWeight();
+        correction += static_cast<float>(loadHistory(*lastMoveCorrPtr)) * corrHistLastMoveWeight();
 
     if (contCorrPtr != nullptr)
-        correction += static_cast<float>(*contCorrPtr) * corrHistContWeight();
+        correction += static_cast<float>(loadHistory(*contCorrPtr)) * corrHistContWeight();
 
     *(plyData.correctedEval) += static_cast<i32>(correction);
 
@@ -210,6 +238,7 @@ constexpr i32 getEval(ThreadData* td, PlyData& plyData)
 
 constexpr void updateHistories(
     ThreadData* td,
+    const ContHists& contHists,
     const Move move,
     const std::optional<PieceType> captured,
     const i32 depth,
@@ -217,8 +246,10 @@ constexpr void updateHistories(
     const ArrayVec<std::pair<Move, std::optional<PieceType>>, 256>& noisiesToPenalize,
     const ArrayVec<Move, 256>& quietsToPenalize)
 {
+    HistoryTable& historyTable = td->histories->historyTable;
+
     HistoryEntry& histEntry
-        = td->historyTable[td->pos.sideToMove()][move.pieceType()][move.to()];
+        = historyTable[td->pos.sideToMove()][move.pieceType()][move.to()];
 
     i32 histBonus = std::clamp<i32>(
         depth * histBonusMul() - histBonusOffset(), 0, histBonusMax()
@@ -234,7 +265,7 @@ constexpr void updateHistories(
     for (const auto [move2, captured2] : noisiesToPenalize)
     {
         HistoryEntry& histEntry2
-            = td->historyTable[td->pos.sideToMove()][move2.pieceType()][move2.to()];
+            = historyTable[td->pos.sideToMove()][move2.pieceType()][move2.to()];
 
         histEntry2.updateNoisyHistory(captured2, move2.promotion(), histMalus);
     }
@@ -242,15 +273,15 @@ constexpr void updateHistories(
     if (td->pos.isQuiet(move))
     {
         // Increase move's main hist and cont hist
-        histEntry.updateMainHistContHist(td->pos, move, histBonus);
+        histEntry.updateMainHistContHist(td->pos, move, contHists, histBonus);
 
         // Decrease main hist and cont hist of quiet moves to penalize
         for (const Move move2 : quietsToPenalize)
         {
             HistoryEntry& histEntry2
-                = td->historyTable[td->pos.sideToMove()][move2.pieceType()][move2.to()];
+                = historyTable[td->pos.sideToMove()][move2.pieceType()][move2.to()];
 
-            histEntry2.updateMainHistContHist(td->pos, move2, histMalus);
+            histEntry2.updateMainHistContHist(td->pos, move2, contHists, histMalus);
         }
     }
     else {
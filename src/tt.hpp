@@ -4,6 +4,7 @@
 
 #include "utils.hpp"
 #include "move.hpp"
+#include "profiler.hpp"
 #include <cmath>
 #include <tuple>
 
@@ -27,6 +28,8 @@ public:
     constexpr std::tuple<std::optional<i32>, std::optional<i32>, Bound, Move> get(
         const u64 zobristHash, const i16 ply) const
     {
+        PROFILE_SCOPE(TTProbe);
+
         if (mZobristHash != zobristHash || mBound == Bound::None)
             return { std::nullopt, std::nullopt, Bound::None, MOVE_NONE };
 
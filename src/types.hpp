@@ -18,7 +18,7 @@ using i64 = int64_t;
 using Bitboard = u64;
 
 enum class ColorCode : i32 {
-    Green = 32, Yellow = 33
+    Red = 31, Green = 32, Yellow = 33
 };
 
 enum class Square : i8 {
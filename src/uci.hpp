@@ -7,9 +7,18 @@
 #include "move_gen.hpp"
 #include "search.hpp"
 #include "bench.hpp"
+#include "perft.hpp"
+#include <cctype>
 
 namespace uci {
 
+// Nodestime mode (nodes per millisecond, 0 if disabled)
+inline u64 nodesTime = 0;
+
+inline size_t multiPV = 1;
+
+inline SmpMode smpMode = SmpMode::LazySMP;
+
 inline void uci();
 
 inline void setoption(const std::vector<std::string>& tokens, Searcher& searcher);
@@ -19,6 +28,8 @@ constexpr void position(const std::vector<std::string>& tokens, Position& pos);
 inline void go(
     const std::vector<std::string>& tokens, Position& pos, Searcher& searcher);
 
+inline void speedtest(const std::vector<std::string>& tokens);
+
 inline void runCommand(std::string& command, Position& pos, Searcher& searcher)
 {
     trim(command);
@@ -44,7 +55,11 @@ inline void runCommand(std::string& command, Position& pos, Searcher& searcher)
     else if (tokens[0] == "go")
         go(tokens, pos, searcher);
     else if (command == "quit")
+    {
+        // exit() doesn't destroy the searcher, so write the last search's record now
+        searcher.flushTelemetry();
         exit(EXIT_SUCCESS);
+    }
     // Non-UCI commands
     else if (command == "d"
     || command == "display"
@@ -53,39 +68,159 @@ inline void runCommand(std::string& command, Position& pos, Searcher& searcher)
     {
         pos.print();
     }
-    else if (tokens[0] == "perft" && tokens.size() == 2)
+    else if ((tokens[0] == "perft"
+    || tokens[0] == "perftsplit"
+    || tokens[0] == "splitperft"
+    || tokens[0] == "perftdivide"
+    || tokens[0] == "divideperft")
+    && tokens.size() >= 2)
     {
+        // "perft <depth> [threads <n>] [hash <MiB>]"
+        // With threads or hash, the subtrees are split across threads and hashed
+
         const i32 depth = stoi(tokens[1]);
+        const bool split = tokens[0] != "perft";
+
+        std::optional<size_t> numThreads = std::nullopt, hashMebibytes = std::nullopt;
+
+        for (size_t i = 2; i + 1 < tokens.size(); i += 2)
+        {
+            const size_t value = static_cast<size_t>(std::max<i64>(stoll(tokens[i + 1]), 1));
+
+            if (tokens[i] == "threads")
+                numThreads = value;
+            else if (tokens[i] == "hash")
+                hashMebibytes = value;
+        }
 
         const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
-        const u64 nodes = perft(pos, depth);
+        u64 nodes = 0;
+
+        if (!numThreads.has_value() && !hashMebibytes.has_value())
+            nodes = split ? perftSplit(pos, depth) : perft(pos, depth);
+        else if (depth <= 0)
+            nodes = split ? perftSplit(pos, depth) : 1;
+        else {
+            PerftTable table(hashMebibytes.value_or(64));
+
+            const auto rootMovesNodes
+                = parallelPerftSplit(pos, depth, numThreads.value_or(1), table);
+
+            for (const auto& [move, moveNodes] : rootMovesNodes)
+            {
+                if (split)
+                    std::cout << move.toUci() << ": " << moveNodes << std::endl;
+
+                nodes += moveNodes;
+            }
+
+            if (split)
+                std::cout << "Total: " << nodes << std::endl;
+        }
+
         const u64 nps = getNps(nodes, millisecondsElapsed(start));
 
         std::cout << nodes << " nodes " << nps << " nps" << std::endl;
     }
-    else if ((tokens[0] == "perftsplit"
-    || tokens[0] == "splitperft"
-    || tokens[0] == "perftdivide"
-    || tokens[0] == "divideperft")
-    && tokens.size() == 2)
+    else if (tokens[0] == "perftsuite" && tokens.size() >= 2)
     {
-        const i32 depth = stoi(tokens[1]);
+        // "perftsuite <epd file> [depth <maxDepth>] [threads <n>] [hash <MiB>]"
 
-        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
-        const u64 nodes = perftSplit(pos, depth);
-        const u64 nps = getNps(nodes, millisecondsElapsed(start));
+        i32 maxDepth = static_cast<i32>(MAX_DEPTH);
+        size_t numThreads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+        size_t hashMebibytes = 256;
 
-        std::cout << nodes << " nodes " << nps << " nps" << std::endl;
+        for (size_t i = 2; i + 1 < tokens.size(); i += 2)
+        {
+            const i64 value = std::max<i64>(stoll(tokens[i + 1]), 1);
+
+            if (tokens[i] == "depth")
+                maxDepth = static_cast<i32>(value);
+            else if (tokens[i] == "threads")
+                numThreads = static_cast<size_t>(value);
+            else if (tokens[i] == "hash")
+                hashMebibytes = static_cast<size_t>(value);
+        }
+
+        perftSuite(tokens[1], maxDepth, numThreads, hashMebibytes);
     }
     else if (tokens[0] == "bench" || tokens[0] == "benchmark")
     {
-        if (tokens.size() > 1)
+        // "bench [depth]" or "bench [depth <d>] [nodes <n>] [movetime <ms>] [threads <t>]
+        // [hash <mb>] [runs <r>] [json] [perf]"
+
+        BenchConfig benchConfig = { };
+
+        for (size_t i = 1; i < tokens.size(); i++)
+        {
+            const std::string& key = tokens[i];
+
+            if (key == "json")
+                benchConfig.json = true;
+            else if (key == "perf")
+                benchConfig.perfCounters = true;
+            else if (i == 1 && std::isdigit(static_cast<unsigned char>(key[0])))
+                benchConfig.depth = stoi(key);
+            else if (i + 1 < tokens.size())
+            {
+                const u64 value = static_cast<u64>(std::max<i64>(stoll(tokens[++i]), 1));
+
+                if (key == "depth")
+                    benchConfig.depth = static_cast<i32>(value);
+                else if (key == "nodes")
+                    benchConfig.maxNodes = value;
+                else if (key == "movetime")
+                    benchConfig.moveTimeMs = value;
+                else if (key == "threads")
+                    benchConfig.numThreads = value;
+                else if (key == "hash")
+                    benchConfig.hashMb = value;
+                else if (key == "runs" || key == "repeat")
+                    benchConfig.numRuns = value;
+            }
+        }
+
+        bench(benchConfig);
+    }
+    else if (tokens[0] == "threadscaling" && tokens.size() >= 2)
+    {
+        // "threadscaling <maxThreads> [depth] [ABDADA] [fens <n>] [csv] [sharedhistory]"
+
+        const size_t maxThreads = static_cast<size_t>(std::max<i64>(stoll(tokens[1]), 1));
+
+        i32 depth = 12;
+        SmpMode mode = SmpMode::LazySMP;
+        size_t numFens = 8;
+        bool csv = false;
+        bool sharedHistories = false;
+
+        for (size_t i = 2; i < tokens.size(); i++)
         {
-            const i32 depth = stoi(tokens[1]);
-            bench(depth);
+            if (tokens[i] == "ABDADA" || tokens[i] == "abdada")
+                mode = SmpMode::ABDADA;
+            else if (tokens[i] == "csv")
+                csv = true;
+            else if (tokens[i] == "sharedhistory" || tokens[i] == "SharedHistory")
+                sharedHistories = true;
+            else if (tokens[i] == "fens" && i + 1 < tokens.size())
+                numFens = static_cast<size_t>(std::max<i64>(stoll(tokens[++i]), 1));
+            else if (std::isdigit(static_cast<unsigned char>(tokens[i][0])))
+                depth = stoi(tokens[i]);
         }
-        else
-            bench();
+
+        threadScaling(maxThreads, depth, mode, numFens, csv, sharedHistories);
+    }
+    else if (command == "stats")
+        searcher.stats().print();
+    else if (tokens[0] == "speedtest")
+        speedtest(tokens);
+    else if (tokens[0] == "latency")
+    {
+        const size_t numSearches = tokens.size() > 1
+                                 ? static_cast<size_t>(std::max<i64>(stoll(tokens[1]), 1))
+                                 : 100;
+
+        latency(searcher, numSearches);
     }
     else if (command == "eval" || command == "evaluate" || command == "evaluation")
     {
@@ -98,14 +233,15 @@ inline void runCommand(std::string& command, Position& pos, Searcher& searcher)
         pos.undoMove();
     else if (command == "movepicker")
     {
-        const std::unique_ptr<HistoryTable> historyTable = std::make_unique<HistoryTable>();
+        const std::unique_ptr<Histories> histories = std::make_unique<Histories>();
+        const ContHists contHists = histories->contHists(pos);
 
         const auto printMoves = [&] (const bool noisiesOnly) constexpr
         {
             MovePicker mp = MovePicker(noisiesOnly, MOVE_NONE, MOVE_NONE);
 
             while (true) {
-                const auto [move, moveScore] = mp.nextLegal(pos, *historyTable);
+                const auto [move, moveScore] = mp.nextLegal(pos, histories->historyTable, contHists);
 
                 if (!move) break;
 
@@ -131,6 +267,13 @@ inline void uci()
     std::cout << "\nid author zzzzz";
     std::cout << "\noption name Hash type spin default 32 min 1 max 131072";
     std::cout << "\noption name Threads type spin default 1 min 1 max 512";
+    std::cout << "\noption name NumaAffinity type check default false";
+    std::cout << "\noption name SharedHistory type check default false";
+    std::cout << "\noption name SpinWait type check default false";
+    std::cout << "\noption name SMP type combo default LazySMP var LazySMP var ABDADA";
+    std::cout << "\noption name MultiPV type spin default 1 min 1 max 256";
+    std::cout << "\noption name nodestime type spin default 0 min 0 max 100000";
+    std::cout << "\noption name TelemetryFile type string default <empty>";
 
     #if defined(TUNE)
         for (const auto& pair : tunableParams)
@@ -163,7 +306,7 @@ inline void setoption(const std::vector<std::string>& tokens, Searcher& searcher
     if (optionName == "Hash" || optionName == "hash")
     {
         const i64 newMebibytes = std::max<i64>(stoll(optionValue), 1);
-        resizeTT(searcher.mTT, static_cast<size_t>(newMebibytes));
+        searcher.resizeTT(static_cast<size_t>(newMebibytes));
         printTTSize(searcher.mTT);
     }
     else if (optionName == "Threads" || optionName == "threads")
@@ -172,6 +315,63 @@ inline void setoption(const std::vector<std::string>& tokens, Searcher& searcher
         searcher.setThreads(static_cast<size_t>(newNumThreads));
         std::cout << "info string Threads set to " << newNumThreads << std::endl;
     }
+    else if (optionName == "NumaAffinity" || optionName == "numaaffinity")
+    {
+        searcher.setNumaAffinity(optionValue == "true");
+
+        std::cout << "info string NumaAffinity set to " << optionValue
+                  << " (" << searcher.numNetReplicas() << " net replicas)"
+                  << std::endl;
+    }
+    else if (optionName == "SharedHistory" || optionName == "sharedhistory")
+    {
+        searcher.setSharedHistories(optionValue == "true");
+
+        std::cout << "info string SharedHistory set to " << optionValue
+                  << " (histories use " << searcher.historiesBytes() / 1024 << " KiB)"
+                  << std::endl;
+    }
+    else if (optionName == "SpinWait" || optionName == "spinwait")
+    {
+        searcher.setSpinWait(optionValue == "true");
+        std::cout << "info string SpinWait set to " << optionValue << std::endl;
+    }
+    else if (optionName == "SMP" || optionName == "smp")
+    {
+        smpMode = optionValue == "ABDADA" || optionValue == "abdada"
+                ? SmpMode::ABDADA
+                : SmpMode::LazySMP;
+
+        std::cout << "info string SMP set to "
+                  << (smpMode == SmpMode::ABDADA ? "ABDADA" : "LazySMP")
+                  << std::endl;
+    }
+    else if (optionName == "MultiPV" || optionName == "multipv")
+    {
+        multiPV = static_cast<size_t>(std::clamp<i64>(stoll(optionValue), 1, 256));
+        std::cout << "info string MultiPV set to " << multiPV << std::endl;
+    }
+    else if (optionName == "nodestime" || optionName == "NodesTime")
+    {
+        nodesTime = static_cast<u64>(std::max<i64>(stoll(optionValue), 0));
+        std::cout << "info string nodestime set to " << nodesTime << std::endl;
+    }
+    else if (optionName == "TelemetryFile" || optionName == "telemetryfile")
+    {
+        // File path may contain spaces
+        std::string filePath = "";
+
+        for (size_t i = 4; i < tokens.size(); i++)
+            filePath += (i > 4 ? " " : "") + tokens[i];
+
+        if (filePath == "<empty>") filePath = "";
+
+        searcher.setTelemetryFile(filePath);
+
+        std::cout << "info string TelemetryFile set to "
+                  << (filePath == "" ? "<empty> (disabled)" : filePath)
+                  << std::endl;
+    }
     #if defined(TUNE)
     else if (tunableParams.count(optionName) > 0)
     {
@@ -236,34 +436,62 @@ inline void go(
     const std::vector<std::string>& tokens, Position& pos, Searcher& searcher)
 {
     SearchConfig searchConfig = { };
+    searchConfig.nodesTime = nodesTime;
+    searchConfig.multiPV = multiPV;
+    searchConfig.smpMode = smpMode;
 
     [[maybe_unused]] u64 incrementMs = 0;
     bool isMoveTime = false;
 
-    for (size_t i = 1; i < tokens.size() - 1; i += 2)
+    for (size_t i = 1; i < tokens.size(); i++)
     {
-        const u64 value = static_cast<u64>(std::max<i64>(std::stoll(tokens[i + 1]), 0));
+        // "searchmoves" is followed by a list of moves
+        if (tokens[i] == "searchmoves")
+        {
+            const auto moves = legalMoves<MoveGenType::AllMoves>(pos);
+
+            const auto legalMoveFromUci = [&] (const std::string& uciMove) -> Move
+            {
+                for (const Move move : moves)
+                    if (move.toUci() == uciMove)
+                        return move;
+
+                return MOVE_NONE;
+            };
 
-        if ((tokens[i] == "wtime" && pos.sideToMove() == Color::White)
-        ||  (tokens[i] == "btime" && pos.sideToMove() == Color::Black))
+            while (i + 1 < tokens.size() && legalMoveFromUci(tokens[i + 1]))
+                searchConfig.searchMoves.push_back(legalMoveFromUci(tokens[++i]));
+
+            continue;
+        }
+
+        // Other tokens are followed by a value
+        if (i + 1 >= tokens.size() || tokens[i] == "infinite" || tokens[i] == "ponder")
+            continue;
+
+        const std::string& key = tokens[i];
+        const u64 value = static_cast<u64>(std::max<i64>(std::stoll(tokens[++i]), 0));
+
+        if ((key == "wtime" && pos.sideToMove() == Color::White)
+        ||  (key == "btime" && pos.sideToMove() == Color::Black))
             searchConfig.hardMs = value;
 
-        else if ((tokens[i] == "winc" && pos.sideToMove() == Color::White)
-        ||       (tokens[i] == "binc" && pos.sideToMove() == Color::Black))
+        else if ((key == "winc" && pos.sideToMove() == Color::White)
+        ||       (key == "binc" && pos.sideToMove() == Color::Black))
             incrementMs = value;
 
-        else if (tokens[i] == "movestogo")
+        else if (key == "movestogo")
         {
 
         }
-        else if (tokens[i] == "movetime")
+        else if (key == "movetime")
         {
             isMoveTime = true;
             searchConfig.hardMs = value;
         }
-        else if (tokens[i] == "depth")
+        else if (key == "depth")
             searchConfig.maxDepth = static_cast<i32>(value);
-        else if (tokens[i] == "nodes")
+        else if (key == "nodes")
             searchConfig.maxNodes = value;
     }
 
@@ -287,9 +515,129 @@ inline void go(
         }
     }
 
+    profiler::reset();
+
     const Move bestMove = searcher.search(pos, searchConfig);
 
     std::cout << "bestmove " << bestMove.toUci() << std::endl;
+
+    if constexpr (profiler::ENABLED)
+        profiler::print();
+
+    searcher.writeTelemetry(bestMove);
+}
+
+// Plays through the speedtest games like a GUI would, with "position ... moves" and
+// "go wtime btime winc binc" commands, using a new searcher with all hardware threads
+// "speedtest [threads <t>] [hash <mb>] [time <ms>] [inc <ms>]"
+inline void speedtest(const std::vector<std::string>& tokens)
+{
+    size_t numThreads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    std::optional<size_t> hashMb = std::nullopt; // Default is 64 MiB per thread
+    u64 baseMs = 10'000, incMs = 100;
+
+    for (size_t i = 1; i + 1 < tokens.size(); i += 2)
+    {
+        const u64 value = static_cast<u64>(std::max<i64>(stoll(tokens[i + 1]), 1));
+
+        if (tokens[i] == "threads")
+            numThreads = value;
+        else if (tokens[i] == "hash")
+            hashMb = value;
+        else if (tokens[i] == "time")
+            baseMs = value;
+        else if (tokens[i] == "inc")
+            incMs = value;
+    }
+
+    Searcher searcher = { };
+    searcher.setThreads(numThreads);
+    searcher.resizeTT(hashMb.value_or(64 * numThreads));
+
+    std::cout << "speedtest: " << numThreads << " threads, "
+              << hashMb.value_or(64 * numThreads) << " MiB hash, "
+              << SPEEDTEST_GAMES.size() << " games at " << baseMs << "+" << incMs << " ms"
+              << std::endl;
+
+    std::vector<u64> movesMs = { };
+    u64 totalNodes = 0, totalMs = 0;
+
+    // Silences std::cout while alive, restoring it even if an exception is thrown
+    struct CoutSilencer
+    {
+        std::streambuf* coutBuf = std::cout.rdbuf(nullptr);
+
+        inline ~CoutSilencer() {
+            std::cout.rdbuf(coutBuf);
+            std::cout.clear();
+        }
+    };
+
+    for (const char* game : SPEEDTEST_GAMES)
+    {
+        Position pos = START_POS;
+        std::string command = "ucinewgame";
+        runCommand(command, pos, searcher);
+
+        const std::vector<std::string> moves = splitString(game, ' ');
+
+        EnumArray<u64, Color> clocksMs = { };
+        clocksMs.fill(baseMs);
+
+        // Search every position of the game
+        for (size_t ply = 0; ply < moves.size(); ply++)
+        {
+            command = "position startpos moves";
+
+            for (size_t i = 0; i < ply; i++)
+                command += " " + moves[i];
+
+            runCommand(command, pos, searcher);
+
+            const Color stm = pos.sideToMove();
+
+            command = "go wtime " + std::to_string(clocksMs[Color::White])
+                    + " btime "   + std::to_string(clocksMs[Color::Black])
+                    + " winc "    + std::to_string(incMs)
+                    + " binc "    + std::to_string(incMs);
+
+            const auto startTime = std::chrono::steady_clock::now();
+
+            // Silence uci info and bestmove
+            {
+                const CoutSilencer coutSilencer = { };
+                runCommand(command, pos, searcher);
+            }
+
+            const u64 ms = millisecondsElapsed(startTime);
+
+            movesMs.push_back(ms);
+            totalMs += ms;
+            totalNodes += searcher.totalNodes();
+
+            // Flag never falls
+            clocksMs[stm] -= std::min<u64>(ms, clocksMs[stm] - 1);
+            clocksMs[stm] += incMs;
+        }
+    }
+
+    std::sort(movesMs.begin(), movesMs.end());
+
+    const auto percentile = [&] (const size_t pct) constexpr {
+        return movesMs[std::min<size_t>(movesMs.size() * pct / 100, movesMs.size() - 1)];
+    };
+
+    std::cout << "positions searched " << movesMs.size() << std::endl;
+    std::cout << "total time ms " << totalMs << std::endl;
+
+    std::cout << "move latency ms"
+              << " p50 " << percentile(50)
+              << " p90 " << percentile(90)
+              << " p99 " << percentile(99)
+              << " max " << movesMs.back()
+              << std::endl;
+
+    std::cout << totalNodes << " nodes " << getNps(totalNodes, totalMs) << " nps" << std::endl;
 }
 
 } // namespace uci
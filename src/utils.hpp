@@ -15,6 +15,10 @@
 #include <bit>
 #include <bitset>
 
+#if defined(__BMI2__)
+    #include <immintrin.h>
+#endif
+
 // General utils
 
 #define stringify(myVar) static_cast<std::string>(#myVar)
@@ -77,6 +81,15 @@ inline u64 millisecondsElapsed(const std::chrono::steady_clock::time_point start
     return static_cast<u64>(duration.count());
 }
 
+inline u64 nanosecondsElapsed(const std::chrono::steady_clock::time_point start)
+{
+    const auto now = std::chrono::steady_clock::now();
+    const auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(now - start);
+
+    assert(duration.count() >= 0);
+    return static_cast<u64>(duration.count());
+}
+
 constexpr u64 getNps(const u64 nodes, const u64 msElapsed)
 {
     return nodes * 1000 / std::max<u64>(msElapsed, 1);
@@ -105,6 +118,27 @@ constexpr u64 pdep(const u64 val, u64 mask)
     return res;
 }
 
+constexpr u64 pext(const u64 val, u64 mask)
+{
+    #if defined(__BMI2__)
+        if !consteval {
+            return _pext_u64(val, mask);
+        }
+    #endif
+
+    u64 res = 0;
+
+    for (u64 bb = 1; mask; bb += bb)
+    {
+        if (val & mask & -mask)
+            res |= bb;
+
+        mask &= mask - 1;
+    }
+
+    return res;
+}
+
 // Square utils
 
 constexpr Square toSquare(const File f, const Rank r)
@@ -0,0 +1,240 @@
+// clang-format off
+
+#include "../src/position.hpp"
+#include "../src/move_gen.hpp"
+#include "../src/nnue.hpp"
+#include "../src/tt.hpp"
+#include "positions.hpp"
+#include <random>
+#include <iomanip>
+
+// Micro-benchmarks of engine primitives, in nanoseconds per operation
+// warm: the operation is repeated over a few positions, so its data stays in cache
+// cold: caches are flushed before each small batch of operations
+
+constexpr size_t WARM_OPS = 1'000'000;
+constexpr size_t COLD_BATCHES = 250;
+constexpr size_t COLD_BATCH_SIZE = 16;
+constexpr size_t FLUSH_BYTES = 64ULL * 1024 * 1024;
+
+std::vector<u8> gFlushBuffer = std::vector<u8>(FLUSH_BYTES, 1);
+
+// Results are accumulated here so the compiler can't optimize the operations away
+u64 gSink = 0;
+
+// Evict the caches by touching a buffer larger than the LLC
+inline void flushCaches()
+{
+    for (size_t i = 0; i < gFlushBuffer.size(); i += 64)
+        gFlushBuffer[i]++;
+
+    gSink += gFlushBuffer[gFlushBuffer.size() / 2];
+}
+
+// op(i) performs the i-th operation
+template<typename Op>
+inline void microbench(const std::string& name, Op&& op)
+{
+    // Warm
+    for (size_t i = 0; i < WARM_OPS / 16; i++)
+        op(i);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < WARM_OPS; i++)
+        op(i);
+
+    const double warmNs = static_cast<double>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start
+        ).count()
+    ) / static_cast<double>(WARM_OPS);
+
+    // Cold
+    u64 coldNs = 0;
+
+    for (size_t batch = 0; batch < COLD_BATCHES; batch++)
+    {
+        flushCaches();
+
+        start = std::chrono::steady_clock::now();
+
+        for (size_t i = batch * COLD_BATCH_SIZE; i < (batch + 1) * COLD_BATCH_SIZE; i++)
+            op(i);
+
+        coldNs += static_cast<u64>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start
+        ).count());
+    }
+
+    std::cout << std::left << std::setw(34) << name << std::right
+              << std::setw(12) << warmNs
+              << std::setw(12)
+              << static_cast<double>(coldNs) / static_cast<double>(COLD_BATCHES * COLD_BATCH_SIZE)
+              << std::endl;
+}
+
+int main()
+{
+    std::cout << colored("Running micro-benchmarks...", ColorCode::Yellow) << std::endl;
+
+    std::vector<Position> positions = {
+        START_POS, POS_KIWIPETE, POS_3, POS_4, POS_4_MIRRORED, POS_5, POS_IN_CHECK
+    };
+
+    // Every pseudolegal move of every position, and the legal ones
+    std::vector<std::pair<size_t, Move>> pseudolegals = { }, legals = { };
+
+    for (size_t posIdx = 0; posIdx < positions.size(); posIdx++)
+        for (const Move move : pseudolegalMoves<MoveGenType::AllMoves>(positions[posIdx]))
+        {
+            pseudolegals.push_back({ posIdx, move });
+
+            if (isPseudolegalLegal(positions[posIdx], move))
+                legals.push_back({ posIdx, move });
+        }
+
+    std::vector<nnue::BothAccumulators> bothAccs = { };
+
+    for (const Position& pos : positions)
+        bothAccs.push_back(nnue::BothAccumulators(pos));
+
+    // Finny table with every entry reset (empty board, biases)
+    auto finnyTable = std::make_unique<nnue::FinnyTable>();
+
+    for (const Color color : EnumIter<Color>())
+        for (nnue::FinnyTableForColor::value_type& entries : (*finnyTable)[color])
+            for (nnue::FinnyTableEntry& finnyEntry : entries)
+            {
+                finnyEntry.accumulator = nnue::NET->hiddenBiases[color];
+                finnyEntry.colorBbs  = { };
+                finnyEntry.piecesBbs = { };
+            }
+
+    std::mt19937_64 rng(12345);
+
+    // Random occupancies for the slider attacks lookups
+    std::vector<Bitboard> occupancies = { };
+
+    for (size_t i = 0; i < 4096; i++)
+        occupancies.push_back(rng() & rng());
+
+    std::vector<u64> hashes = { };
+
+    for (size_t i = 0; i < 4096; i++)
+        hashes.push_back(rng());
+
+    std::vector<TTEntry> tt = { };
+    resizeTT(tt, 64);
+
+    const std::ios_base::fmtflags oldFlags = std::cout.flags();
+    const std::streamsize oldPrecision = std::cout.precision();
+
+    std::cout << std::fixed << std::setprecision(2)
+              << std::left << std::setw(34) << "ns/op" << std::right
+              << std::setw(12) << "warm"
+              << std::setw(12) << "cold"
+              << std::endl;
+
+    const auto posAt = [&] (const size_t i) -> Position& {
+        return positions[i % positions.size()];
+    };
+
+    microbench("pseudolegalMoves<NoisyOnly>", [&] (const size_t i) {
+        gSink += pseudolegalMoves<MoveGenType::NoisyOnly>(posAt(i)).size();
+    });
+
+    microbench("pseudolegalMoves<QuietOnly>", [&] (const size_t i) {
+        gSink += pseudolegalMoves<MoveGenType::QuietOnly>(posAt(i)).size();
+    });
+
+    microbench("pseudolegalMoves<AllMoves>", [&] (const size_t i) {
+        gSink += pseudolegalMoves<MoveGenType::AllMoves>(posAt(i)).size();
+    });
+
+    microbench("legalMoves<AllMoves>", [&] (const size_t i) {
+        gSink += legalMoves<MoveGenType::AllMoves>(posAt(i)).size();
+    });
+
+    microbench("isPseudolegalLegal", [&] (const size_t i)
+    {
+        const auto [posIdx, move] = pseudolegals[i % pseudolegals.size()];
+        gSink += isPseudolegalLegal(positions[posIdx], move);
+    });
+
+    microbench("hasLegalMove", [&] (const size_t i) {
+        gSink += hasLegalMove(posAt(i));
+    });
+
+    microbench("makeMove + undoMove", [&] (const size_t i)
+    {
+        const auto [posIdx, move] = legals[i % legals.size()];
+        positions[posIdx].makeMove(move);
+        gSink += positions[posIdx].zobristHash();
+        positions[posIdx].undoMove();
+    });
+
+    microbench("SEE", [&] (const size_t i)
+    {
+        const auto [posIdx, move] = pseudolegals[i % pseudolegals.size()];
+        gSink += positions[posIdx].SEE(move);
+    });
+
+    microbench("attackers", [&] (const size_t i) {
+        gSink += posAt(i).attackers(static_cast<Square>(i % 64));
+    });
+
+    microbench("getRookAttacks", [&] (const size_t i) {
+        gSink += getRookAttacks(static_cast<Square>(i % 64), occupancies[i % occupancies.size()]);
+    });
+
+    microbench("getBishopAttacks", [&] (const size_t i)
+    {
+        gSink += getBishopAttacks(
+            static_cast<Square>(i % 64), occupancies[i % occupancies.size()]
+        );
+    });
+
+    microbench("BothAccumulators(pos)", [&] (const size_t i)
+    {
+        const nnue::BothAccumulators newBothAccs = nnue::BothAccumulators(posAt(i));
+        gSink += static_cast<u64>(newBothAccs.mAccumulators[Color::White][0]);
+    });
+
+    microbench("updateMove (incl. make/undo)", [&] (const size_t i)
+    {
+        const auto [posIdx, move] = legals[i % legals.size()];
+
+        positions[posIdx].makeMove(move);
+
+        nnue::BothAccumulators newBothAccs;
+        newBothAccs.mUpdated = false;
+        newBothAccs.updateMove(bothAccs[posIdx], positions[posIdx], *finnyTable);
+        gSink += static_cast<u64>(newBothAccs.mAccumulators[Color::White][0]);
+
+        positions[posIdx].undoMove();
+    });
+
+    microbench("nnue::evaluate", [&] (const size_t i)
+    {
+        const size_t posIdx = i % positions.size();
+        gSink += static_cast<u64>(nnue::evaluate(bothAccs[posIdx], positions[posIdx].sideToMove()));
+    });
+
+    microbench("ttEntryRef + get", [&] (const size_t i)
+    {
+        const u64 hash = hashes[i % hashes.size()];
+        gSink += std::get<3>(ttEntryRef(tt, hash).get(hash, 0)).asU16();
+    });
+
+    microbench("ttEntryRef + update", [&] (const size_t i)
+    {
+        const u64 hash = hashes[i % hashes.size()];
+        ttEntryRef(tt, hash).update(hash, 10, 25, 0, Bound::Lower, MOVE_NONE);
+    });
+
+    std::cout.flags(oldFlags);
+    std::cout.precision(oldPrecision);
+
+    std::cout << "(" << gSink << ")" << std::endl;
+}
@@ -77,5 +77,31 @@ int main() {
     pos.undoMove();
     assert(pos.gameState(hasLegalMove) == GameState::Ongoing);
 
+    // Draw by repetition with the first occurrence in the shared history
+    pos = START_POS;
+    pos.makeMove("g1f3");
+    pos.makeMove("g8f6");
+    pos.makeMove("f3g1");
+    pos.shareHistory();
+    Position posCopy = pos;
+    assert(posCopy.gameState(hasLegalMove) == GameState::Ongoing);
+    posCopy.makeMove("f6g8");
+    assert(posCopy.gameState(hasLegalMove) == GameState::Draw);
+    assert(posCopy.fen() == "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 4 3");
+
+    // isDraw() doesn't detect checkmate and stalemate, but checkmate beats the 50-move rule
+    pos = POS_CHECKMATE;
+    assert(!pos.isDraw(hasLegalMove));
+    pos.setPliesSincePawnOrCapture(100);
+    assert(!pos.isDraw(hasLegalMove));
+    pos = POS_STALEMATE;
+    assert(!pos.isDraw(hasLegalMove));
+    pos.setPliesSincePawnOrCapture(100);
+    assert(pos.isDraw(hasLegalMove));
+    pos = POS_IN_CHECK;
+    pos.setPliesSincePawnOrCapture(100);
+    assert(pos.isDraw(hasLegalMove));
+    assert(Position("k7/8/8/8/8/8/8/KN6 w - - 0 1").isDraw(hasLegalMove));
+
     std::cout << colored("Game state tests passed", ColorCode::Green) << std::endl;
 }
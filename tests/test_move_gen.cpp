@@ -2,9 +2,38 @@
 
 #include "../src/position.hpp"
 #include "../src/move_gen.hpp"
+#include "../src/perft.hpp"
 #include "positions.hpp"
 #include <cassert>
 
+// Asserts that legalMoves() equals the pseudolegal moves that pass isPseudolegalLegal(),
+// in every position of the tree
+template<MoveGenType moveGenType>
+void assertLegalMovesMatch(Position& pos, const i32 depth)
+{
+    ArrayVec<Move, 256> expected;
+
+    for (const Move move : pseudolegalMoves<moveGenType>(pos))
+        if (isPseudolegalLegal(pos, move))
+            expected.push_back(move);
+
+    const ArrayVec<Move, 256> legals = legalMoves<moveGenType>(pos);
+
+    assert(legals.size() == expected.size());
+
+    for (size_t i = 0; i < legals.size(); i++)
+        assert(legals[i] == expected[i]);
+
+    if (depth <= 1) return;
+
+    for (const Move move : legalMoves<MoveGenType::AllMoves>(pos))
+    {
+        pos.makeMove(move);
+        assertLegalMovesMatch<moveGenType>(pos, depth - 1);
+        pos.undoMove();
+    }
+}
+
 int main() {
     std::cout << colored("Running move gen tests...", ColorCode::Yellow) << std::endl;
 
@@ -25,6 +54,24 @@ int main() {
     pos = POS_STALEMATE;
     assert(!hasLegalMove(pos));
 
+    // legalMoves()
+    for (const Position& position : {
+        START_POS, POS_KIWIPETE, POS_3, POS_4, POS_4_MIRRORED, POS_5,
+        POS_IN_CHECK, POS_CHECKMATE, POS_STALEMATE,
+        // En passant that exposes our king to a rook
+        Position("8/8/8/KPp4r/8/8/8/6k1 w - c6 0 2"),
+        // En passant that captures the checker
+        Position("8/8/8/2k5/3Pp3/8/8/4K3 b - d3 0 1"),
+        // Pawn double push that blocks a check, while the single push doesn't
+        Position("4k3/q7/8/8/8/8/3P4/6K1 w - - 0 1")
+    })
+    {
+        Position posCopy = position;
+        assertLegalMovesMatch<MoveGenType::AllMoves>(posCopy, 3);
+        assertLegalMovesMatch<MoveGenType::NoisyOnly>(posCopy, 3);
+        assertLegalMovesMatch<MoveGenType::QuietOnly>(posCopy, 3);
+    }
+
     // Perft
 
     Position startPos     = START_POS;
@@ -55,5 +102,15 @@ int main() {
     // Position Kiwipete perft(5)
     assert(perft(posKiwipete, 5) == 193690690ULL);
 
+    // Parallel hashed perft
+    PerftTable perftTable(16);
+    assert(parallelPerft(startPos, 0, 4, perftTable) == 1ULL);
+    assert(parallelPerft(startPos, 1, 4, perftTable) == 20ULL);
+    assert(parallelPerft(startPos, 2, 4, perftTable) == 400ULL);
+    assert(parallelPerft(startPos, 6, 4, perftTable) == 119060324ULL);
+    assert(parallelPerft(posKiwipete, 5, 4, perftTable) == 193690690ULL);
+    assert(parallelPerft(pos3, 6, 4, perftTable) == 11030083ULL);
+    assert(parallelPerft(pos4Mirrored, 5, 4, perftTable) == 15833292ULL);
+
     std::cout << colored("Move gen tests passed", ColorCode::Green) << std::endl;
 }
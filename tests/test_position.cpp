@@ -1,6 +1,7 @@
 // clang-format off
 
 #include "../src/position.hpp"
+#include "../src/move_gen.hpp"
 #include "positions.hpp"
 #include <cassert>
 
@@ -40,6 +41,32 @@ int main() {
     assert(pos.attacks(Color::White) == 5532389481728ULL);
     assert(pos.attacks(Color::Black) == 5797534614998483972ULL);
 
+    // Position.attacksBy()
+
+    assert(pos.attacksBy(Color::White, PieceType::Knight) == getKnightAttacks(Square::B4));
+
+    assert(pos.attacksBy(Color::Black, PieceType::Rook)
+        == getRookAttacks(Square::C6, pos.occupied()));
+
+    assert(pos.attacksBy(Color::Black, PieceType::Pawn)
+        == (squareBb(Square::B6) | squareBb(Square::D6)));
+
+    // Updated by makeMove()
+    pos.makeMove(Move(Square::B4, Square::C6, MoveFlag::Knight));
+    assert(pos.attacksBy(Color::Black, PieceType::Rook) == 0);
+    assert(pos.attacksBy(Color::White, PieceType::Knight) == getKnightAttacks(Square::C6));
+    assert(pos.attacks(Color::White) == pos.attacks(Color::White, pos.occupied()));
+    assert(pos.attacks(Color::Black) == pos.attacks(Color::Black, pos.occupied()));
+
+    // Not updated by makeMove<false>(), then recomputed by the next makeMove()
+    pos = POS_KIWIPETE;
+    pos.makeMove<false>(Move(Square::E2, Square::A6, MoveFlag::Bishop));
+    assert(pos.attacks(Color::White) == pos.attacks(Color::White, pos.occupied()));
+    assert(pos.attacks(Color::Black) == pos.attacks(Color::Black, pos.occupied()));
+    pos.makeMove(Move(Square::B4, Square::C3, MoveFlag::Pawn));
+    assert(pos.attacks(Color::White) == pos.attacks(Color::White, pos.occupied()));
+    assert(pos.attacks(Color::Black) == pos.attacks(Color::Black, pos.occupied()));
+
     // Position.attackers()
     assert(Position("r1b1kbnr/ppp2ppp/2np4/1B2p1q1/3P2P1/1P2PP2/P1P4P/RNBQK1NR b KQkq - 0 5")
         .attackers(Square::F5) == 288230652103360512ULL);
@@ -119,5 +146,94 @@ int main() {
     pos.makeMove(MOVE_NONE);
     assert(pos.fen() == "1rq1kbnr/p2b2p1/1p2p2p/3p1pP1/1Q1pP3/1PP4P/P2B1P1R/RN2KBN1 b Qk - 1 15");
 
+    // Position.pieceTypeAt(Square) (mailbox) agrees with the bitboards
+
+    const auto mailboxMatchesBbs = [] (const Position& position)
+    {
+        for (const Square square : EnumIter<Square>())
+        {
+            std::optional<PieceType> expected = std::nullopt;
+
+            for (const PieceType pt : EnumIter<PieceType>())
+                if (hasSquare(position.getBb(pt), square))
+                    expected = pt;
+
+            if (position.pieceTypeAt(square) != expected)
+                return false;
+        }
+
+        return true;
+    };
+
+    for (const Position& position : { START_POS, POS_KIWIPETE, POS_3, POS_4, POS_5 })
+        assert(mailboxMatchesBbs(position));
+
+    const std::string fenBeforeMoves
+        = "rnbqkb1r/4pppp/1p1p1n2/2p4P/2BP2P1/4PN2/p1P2P2/RNBQK2R b KQkq - 5 9";
+
+    pos = Position(fenBeforeMoves);
+
+    // Promotion with capture, castling, double push, en passant, capture, quiet, null move
+    const std::vector<std::string> uciMoves = {
+        "a2b1q", "e1g1", "g7g5", "h5g6", "f6g4", "a1a2"
+    };
+
+    for (const std::string& uciMove : uciMoves)
+    {
+        pos.makeMove(uciMove);
+        assert(mailboxMatchesBbs(pos));
+    }
+
+    pos.makeMove(MOVE_NONE);
+    assert(mailboxMatchesBbs(pos));
+
+    for (size_t i = 0; i <= uciMoves.size(); i++)
+    {
+        pos.undoMove();
+        assert(mailboxMatchesBbs(pos));
+    }
+
+    assert(pos.fen() == fenBeforeMoves);
+
+    // More moves than a position's own state stack holds
+
+    pos = START_POS;
+
+    for (size_t i = 0; i < MAX_OWN_STATES; i++)
+        pos.makeMove(std::array { "g1f3", "g8f6", "f3g1", "f6g8" }[i % 4]);
+
+    assert(pos.zobristHash() == START_POS.zobristHash());
+    assert(pos.currentMoveCounter() == 1 + MAX_OWN_STATES / 2);
+    const Move f6g8 = Move(Square::F6, Square::G8, MoveFlag::Knight);
+    assert(pos.lastMove() == f6g8);
+    assert(pos.nthToLastMove(5) == f6g8);
+
+    pos.undoMove();
+    assert(pos.lastMove() == Move(Square::F3, Square::G1, MoveFlag::Knight));
+
+    // Overflowing in the middle of a make/undo line keeps the line undoable
+
+    pos = START_POS;
+
+    for (size_t i = 0; i < MAX_OWN_STATES - 4; i++)
+        pos.makeMove(std::array { "g1f3", "g8f6", "f3g1", "f6g8" }[i % 4]);
+
+    const std::string fenBeforeOverflow = pos.fen();
+    const u64 hashBeforeOverflow = pos.zobristHash();
+
+    for (const std::string uciMove : { "e2e4", "e7e5", "g1f3", "b8c6", "f1b5", "a7a6" })
+        pos.makeMove(uciMove);
+
+    for (size_t i = 0; i < 6; i++)
+        pos.undoMove();
+
+    assert(pos.fen() == fenBeforeOverflow);
+    assert(pos.zobristHash() == hashBeforeOverflow);
+    assert(pos.zobristHash() == START_POS.zobristHash());
+
+    // Perft from there overflows in its recursion
+    assert(perft(pos, 3) == 8902);
+    assert(pos.fen() == fenBeforeOverflow);
+
     std::cout << colored("Position tests passed", ColorCode::Green) << std::endl;
 }
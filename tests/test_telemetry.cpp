@@ -0,0 +1,76 @@
+// clang-format off
+
+#include "../src/uci.hpp"
+#include <cassert>
+#include <sys/wait.h>
+#include <unistd.h>
+
+inline std::vector<std::string> readLines(const std::string& filePath)
+{
+    std::ifstream file(filePath);
+    std::vector<std::string> lines = { };
+    std::string line;
+
+    while (std::getline(file, line))
+        lines.push_back(line);
+
+    return lines;
+}
+
+int main()
+{
+    std::cout << colored("Running telemetry tests...", ColorCode::Yellow) << std::endl;
+
+    const std::string filePath = "test-telemetry.jsonl";
+
+    // TelemetryWriter.flush()
+
+    std::remove(filePath.c_str());
+
+    {
+        TelemetryWriter writer;
+        writer.setFile(filePath);
+
+        writer.push("{\"record\":1}");
+        writer.flush();
+        assert(readLines(filePath) == std::vector<std::string>({ "{\"record\":1}" }));
+
+        // Still writing after a flush
+        writer.push("{\"record\":2}");
+    }
+
+    assert(readLines(filePath).size() == 2);
+
+    // "quit" right after "go" exits the process, but the search's record is still written
+
+    std::remove(filePath.c_str());
+
+    const pid_t pid = fork();
+
+    if (pid == 0)
+    {
+        Position pos = START_POS;
+        Searcher searcher = { };
+
+        std::vector<std::string> commands = {
+            "setoption name TelemetryFile value " + filePath, "go depth 1", "quit"
+        };
+
+        for (std::string& command : commands)
+            uci::runCommand(command, pos, searcher);
+
+        _exit(EXIT_FAILURE); // "quit" didn't exit
+    }
+
+    i32 status = 0;
+    waitpid(pid, &status, 0);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS);
+
+    const std::vector<std::string> lines = readLines(filePath);
+    assert(lines.size() == 1);
+    assert(lines[0].find("\"bestmove\":") != std::string::npos);
+
+    std::remove(filePath.c_str());
+
+    std::cout << colored("Telemetry tests passed", ColorCode::Green) << std::endl;
+}